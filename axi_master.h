@@ -1,12 +1,76 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdlib.h>
 
 #define SOCK_PATH "/tmp/axi_master_socket"
 
+/* Overrides SOCK_PATH, so that several simulations can run side by side */
+#define SOCK_PATH_ENV "AXI_MASTER_SOCKET"
+
+/* The simulator creates <socket path>.ready once it accepts connections */
+#define SOCK_READY_SUFFIX "ready"
+
+static inline const char *axi_master_sock_path(void)
+{
+	const char *path = getenv(SOCK_PATH_ENV);
+	return path && *path ? path : SOCK_PATH;
+}
+
 struct axi_master_msg {
-	enum {MSG_CODE_WRITE_CMD = 1, MSG_CODE_WRITE_ACK = 2, MSG_CODE_READ_CMD = 3, MSG_CODE_READ_ACK = 4} code;
+	enum {MSG_CODE_WRITE_CMD = 1, MSG_CODE_WRITE_ACK = 2, MSG_CODE_READ_CMD = 3, MSG_CODE_READ_ACK = 4,
+	      MSG_CODE_DUMP_CMD = 5, MSG_CODE_DUMP_ACK = 6, MSG_CODE_STATS = 7} code;
 	uint32_t address;
 	uint32_t data;
 };
 
+/*
+ * Sent on the async socket whenever the IRQ line changes. seq counts rising
+ * edges, a falling edge repeats the seq of the edge it ends. The simulator
+ * measures the time from a rising edge to the first IRQ ack write (bank +
+ * 0x20 or the cause register) and reports it when the simulation ends.
+ */
+struct axi_master_irq_msg {
+	uint32_t level;
+	uint32_t seq;
+	uint64_t sim_time;
+};
+
+/*
+ * Client side view of the connection, sent just before disconnecting as
+ * MSG_CODE_STATS with the size of the struct in data, followed by the struct
+ * itself. Not acknowledged. The simulator prints it next to its own figures
+ * for the connection, so that the time of a round trip can be split into
+ * the client, the sockets and the simulation. Times are wall clock ns.
+ */
+struct axi_master_client_stats {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t send_ns;       /* In send() of requests */
+	uint64_t recv_ns;       /* Waiting in recv() for the replies */
+	uint64_t irq_msgs;      /* IRQ messages received on the async socket */
+	uint64_t irq_raised;    /* Rising edges passed on (e.g. to the guest) */
+	uint64_t irq_lock_ns;   /* Waiting to be allowed to pass them on */
+	uint64_t wall_ns;       /* Connected */
+};
+
+/*
+ * Waveform dump control, MSG_CODE_DUMP_CMD with the command in address and
+ * its argument in data. A trigger starts the dump once, on the first AXI
+ * access to the given address or the first NACK of a byte sent by the
+ * controller, and dumps for the configured window (0 until stopped).
+ */
+enum {
+	DUMP_CMD_START = 1,     /* data: scope bits [7:0], depth [15:8] (0 all levels) */
+	DUMP_CMD_STOP = 2,
+	DUMP_CMD_SCOPE = 3,     /* data: as for start, scope used by triggers */
+	DUMP_CMD_WINDOW = 4,    /* data: clock cycles to dump after a trigger */
+	DUMP_CMD_TRIG_ADDR = 5, /* data: AXI address */
+	DUMP_CMD_TRIG_NACK = 6,
+	DUMP_CMD_TRIG_OFF = 7,
+};
+
+#define DUMP_SCOPE_TB   (1 << 0)
+#define DUMP_SCOPE_TOP  (1 << 1)
+#define DUMP_SCOPE_REGS (1 << 2)
+
@@ -5,13 +5,29 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/un.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 #include <assert.h>
 #include "axi_master.h"
+#include "i2c_mem.h"
 
 static int axi_master_socket_sync;
 static int axi_master_socket_async;
 
+/* Sent to the simulator at the end for its cosimulation report */
+static struct axi_master_client_stats client_stats;
+static uint64_t connect_ns;
+
+static uint64_t now_ns(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
 void axi_master_write(uint32_t address, uint32_t data)
 {
 	struct axi_master_msg msg;
@@ -19,16 +35,22 @@ void axi_master_write(uint32_t address, uint32_t data)
 	msg.address = address;
 	msg.data = data;
 
+	uint64_t t0 = now_ns();
 	if (send(axi_master_socket_sync, &msg, sizeof(msg), 0) == -1) {
 		perror("send");
 		exit(1);
 	}
 
+	uint64_t t1 = now_ns();
 	if (recv(axi_master_socket_sync, &msg, sizeof(msg), 0) <= 0) {
 		perror("recv");
 		exit(1);
 	}
 
+	client_stats.send_ns += t1 - t0;
+	client_stats.recv_ns += now_ns() - t1;
+	client_stats.writes++;
+
 	assert(msg.code == MSG_CODE_WRITE_ACK);
 }
 
@@ -39,98 +61,448 @@ uint32_t axi_master_read(uint32_t address)
 	msg.address = address;
 	msg.data = 0;
 
+	uint64_t t0 = now_ns();
 	if (send(axi_master_socket_sync, &msg, sizeof(msg), 0) == -1) {
 		perror("send");
 		exit(1);
 	}
 
+	uint64_t t1 = now_ns();
 	if (recv(axi_master_socket_sync, &msg, sizeof(msg), 0) <= 0) {
 		perror("recv");
 		exit(1);
 	}
 
+	client_stats.send_ns += t1 - t0;
+	client_stats.recv_ns += now_ns() - t1;
+	client_stats.reads++;
+
 	assert(msg.code == MSG_CODE_READ_ACK);
 	return msg.data;
 }
 
-const uint32_t i2c_ctrl_addr = 0x0000100c;
-const uint32_t i2c_status_addr = 0x00001010;
+/* Waveform dump control, see DUMP_CMD_* in axi_master.h */
+void axi_master_dump(uint32_t cmd, uint32_t arg)
+{
+	struct axi_master_msg msg;
+	msg.code = MSG_CODE_DUMP_CMD;
+	msg.address = cmd;
+	msg.data = arg;
 
-const uint32_t i2c_ctrl_we_bit = 1 << 10;
-const uint32_t i2c_ctrl_start_bit = 1 << 9;
-const uint32_t i2c_ctrl_stop_bit = 1 << 8;
+	if (send(axi_master_socket_sync, &msg, sizeof(msg), 0) == -1) {
+		perror("send");
+		exit(1);
+	}
 
-const uint32_t i2c_status_busy_bit = 1 << 9;
-const uint32_t i2c_status_ack_bit = 1 << 8;
+	if (recv(axi_master_socket_sync, &msg, sizeof(msg), 0) <= 0) {
+		perror("recv");
+		exit(1);
+	}
+
+	assert(msg.code == MSG_CODE_DUMP_ACK);
+}
 
-void i2c_mem_write(uint8_t i2c_addr, uint8_t mem_addr, uint8_t mem_data)
+/* Our side of the connection, for the simulator's report when it ends */
+static void axi_master_send_stats(void)
 {
-	uint32_t status;
-	/* Make sure interface is not busy */
-	while (axi_master_read(i2c_status_addr) & i2c_status_busy_bit);
+	struct axi_master_msg msg;
+	msg.code = MSG_CODE_STATS;
+	msg.address = 0;
+	msg.data = sizeof(client_stats);
 
-	/* Address for write mode */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 0 << 0);
+	client_stats.wall_ns = now_ns() - connect_ns;
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit);
-	assert(status & i2c_status_ack_bit && "I2C address ACK");
+	if (send(axi_master_socket_sync, &msg, sizeof(msg), 0) == -1 ||
+	    send(axi_master_socket_sync, &client_stats, sizeof(client_stats), 0) == -1) {
+		perror("send");
+		exit(1);
+	}
+}
 
-	/* Memory address */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+static const char *i2c_perf_names[] = {
+	"bytes sent", "bytes received", "NACKs",
+	"cycles S_IDLE", "cycles S_SYNC", "cycles S_START", "cycles S_DATA", "cycles S_ACK", "cycles S_STOP",
+	"cycles busy", "cycles idle", "IRQs", "commands",
+};
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit);
-	assert(status & i2c_status_ack_bit && "MEM address ACK");
+void i2c_perf_report(int chan)
+{
+	const int num = sizeof(i2c_perf_names) / sizeof(i2c_perf_names[0]);
+	uint32_t cnt[num];
 
-	/* Memory data */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_stop_bit | mem_data);
+	/* Snapshot all counters at once and restart counting */
+	axi_master_write(i2c_perf_ctrl_addr + chan * i2c_chan_stride, i2c_perf_ctrl_snapshot_bit | i2c_perf_ctrl_clear_bit);
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit);
-	assert(status & i2c_status_ack_bit && "MEM write ACK");
+	for (int i = 0; i < num; i++) {
+		cnt[i] = axi_master_read(i2c_perf_cnt_addr + chan * i2c_chan_stride + i * 4);
+	}
+
+	printf("channel %d performance counters:\n", chan);
+	for (int i = 0; i < num; i++) {
+		printf("  %-16s %10u\n", i2c_perf_names[i], cnt[i]);
+	}
+	/* Counters 9 and 10 are busy and idle cycles */
+	if (cnt[9] + cnt[10]) {
+		printf("  bus busy %.1f%%, %.1f idle cycles per command\n",
+		       100.0 * cnt[9] / (cnt[9] + cnt[10]), cnt[12] ? (double)cnt[10] / cnt[12] : 0.0);
+	}
 }
 
-uint8_t i2c_mem_read(uint8_t i2c_addr, uint8_t mem_addr)
+/* I2C slave models have address 7'b001_0000 */
+#define I2C_ADDR 0x10
+
+/* Small 16 byte memory with one address byte */
+void test_small(int chan)
 {
+#define DATA_SIZE 16
+#define PAGE_SIZE 8
+	uint8_t data[DATA_SIZE];
+
+	/* Generate reference data */
+	for (int i = 0; i < DATA_SIZE; i++) {
+		data[i] = rand();
+	}
+
+	/* Write data to memory in forward order */
+	for (int i = 0; i < DATA_SIZE; i++) {
+		assert(i2c_mem_write(chan, I2C_ADDR, i, data[i]) == 0);
+	}
+
+	/* Read data from memory (and verify) in forward order */
+	for (int i = 0; i < DATA_SIZE; i++) {
+		assert(i2c_mem_read(chan, I2C_ADDR, i) == data[i]);
+	}
+
+	/* Read data from memory (and verify) in reverse order */
+	for (int i = 0; i < DATA_SIZE; i++) {
+		assert(i2c_mem_read(chan, I2C_ADDR, DATA_SIZE - 1 - i) == data[DATA_SIZE - 1 - i]);
+	}
+
+	/* Rewrite memory using hardware page writes (8 byte pages) and verify */
+	for (int i = 0; i < DATA_SIZE; i++) {
+		data[i] = rand();
+	}
+	for (int i = 0; i < DATA_SIZE; i += PAGE_SIZE) {
+		assert(i2c_mem_write_page(chan, I2C_ADDR, i, 0, &data[i], PAGE_SIZE) == 0);
+	}
+
+	for (int i = 0; i < DATA_SIZE; i++) {
+		assert(i2c_mem_read(chan, I2C_ADDR, i) == data[i]);
+	}
+#undef DATA_SIZE
+#undef PAGE_SIZE
+}
+
+/* 24C256 style 32KiB EEPROM with two address bytes and 64 byte pages */
+void test_eeprom(int chan, int bench)
+{
+#define MEM_SIZE 32768
+#define PAGE_SIZE 64
+	static uint8_t data[MEM_SIZE];
+	static uint8_t rdata[MEM_SIZE];
+	int size = bench ? MEM_SIZE : 4 * PAGE_SIZE;
+
+	for (int i = 0; i < size; i++) {
+		data[i] = rand();
+	}
+
+	/* Write whole pages, each followed by the write cycle */
+	for (int i = 0; i < size; i += PAGE_SIZE) {
+		assert(i2c_mem_write_page(chan, I2C_ADDR, i, 1, &data[i], PAGE_SIZE) == 0);
+	}
+
+	/* Sequential read across page boundaries */
+	assert(i2c_mem_read_seq(chan, I2C_ADDR, 0, 1, rdata, size) == 0);
+	for (int i = 0; i < size; i++) {
+		assert(rdata[i] == data[i]);
+	}
+
+	/* Page write starting mid page wraps around to the start of the page */
+	uint8_t wdata[PAGE_SIZE];
+	for (int i = 0; i < PAGE_SIZE; i++) {
+		wdata[i] = rand();
+		data[PAGE_SIZE + (PAGE_SIZE / 2 + i) % PAGE_SIZE] = wdata[i];
+	}
+	assert(i2c_mem_write_page(chan, I2C_ADDR, PAGE_SIZE + PAGE_SIZE / 2, 1, wdata, PAGE_SIZE) == 0);
+	assert(i2c_mem_read_seq(chan, I2C_ADDR, 0, 1, rdata, 3 * PAGE_SIZE) == 0);
+	for (int i = 0; i < 3 * PAGE_SIZE; i++) {
+		assert(rdata[i] == data[i]);
+	}
+#undef MEM_SIZE
+#undef PAGE_SIZE
+}
+
+/* Devices on the buses, must match the default topology of the testbench */
+struct i2c_dev {
+	int chan;
+	uint8_t addr;
+	int size;       /* bytes used by the stress test */
+	int page;
+	int two_byte;
+	uint8_t shadow[1024];
+};
+
+static struct i2c_dev i2c_devs[] = {
+	{.chan = 0, .addr = 0x10, .size = 16,   .page = 16, .two_byte = 0}, /* small */
+	{.chan = 0, .addr = 0x50, .size = 256,  .page = 8,  .two_byte = 0}, /* 24C02 */
+	{.chan = 0, .addr = 0x51, .size = 256,  .page = 8,  .two_byte = 0}, /* 24C02, stretching */
+	{.chan = 1, .addr = 0x10, .size = 1024, .page = 64, .two_byte = 1}, /* 24C256 */
+	{.chan = 1, .addr = 0x54, .size = 1024, .page = 64, .two_byte = 1}, /* 24C256, stretching */
+};
+
+/*
+ * Random mix of page writes and sequential reads to random devices, every
+ * transfer goes to a different device than the previous one more often than
+ * not, which is what stresses address switching on a shared bus.
+ */
+void test_stress(int num_chan, int iterations)
+{
+	const int num_devs = sizeof(i2c_devs) / sizeof(i2c_devs[0]);
+	uint8_t buf[64];
+
+	/* Start from what the devices hold right now */
+	for (int d = 0; d < num_devs; d++) {
+		struct i2c_dev *dev = &i2c_devs[d];
+		if (dev->chan >= num_chan)
+			continue;
+		assert(i2c_mem_read_seq(dev->chan, dev->addr, 0, dev->two_byte, dev->shadow, dev->size) == 0);
+	}
+
+	for (int n = 0; n < iterations; n++) {
+		struct i2c_dev *dev = &i2c_devs[rand() % num_devs];
+		int mem_addr = rand() % dev->size;
+		int len;
+
+		if (dev->chan >= num_chan)
+			continue;
+
+		if (rand() & 1) {
+			/* Write within one page */
+			len = 1 + rand() % (dev->page - mem_addr % dev->page);
+			for (int i = 0; i < len; i++) {
+				buf[i] = rand();
+				dev->shadow[mem_addr + i] = buf[i];
+			}
+			assert(i2c_mem_write_page(dev->chan, dev->addr, mem_addr, dev->two_byte, buf, len) == 0);
+		}
+		else {
+			/* Read, possibly across page boundaries */
+			len = 1 + rand() % sizeof(buf);
+			if (mem_addr + len > dev->size)
+				len = dev->size - mem_addr;
+			assert(i2c_mem_read_seq(dev->chan, dev->addr, mem_addr, dev->two_byte, buf, len) == 0);
+			for (int i = 0; i < len; i++) {
+				assert(buf[i] == dev->shadow[mem_addr + i]);
+			}
+		}
+	}
+}
+
+/* SMBus block device on the first channel, 16 blocks of up to 32 bytes */
+void test_smbus(int chan)
+{
+#define SMB_ADDR 0x58
+	uint8_t data[32];
+	uint8_t rdata[32];
+
+	/* Nothing written yet, a count of 0 is a length error */
+	assert(i2c_smbus_block_read(chan, SMB_ADDR, 7, 1, rdata) == -EMSGSIZE);
+
+	for (int n = 0; n < 8; n++) {
+		int cmd = rand() % 16;
+		int len = 1 + rand() % sizeof(data);
+		int pec = n & 1;
+
+		for (int i = 0; i < len; i++) {
+			data[i] = rand();
+		}
+		assert(i2c_smbus_block_write(chan, SMB_ADDR, cmd, pec, data, len) == 0);
+
+		memset(rdata, 0, sizeof(rdata));
+		assert(i2c_smbus_block_read(chan, SMB_ADDR, cmd, 1, rdata) == len && "SMBus block read PEC");
+		assert(!memcmp(rdata, data, len));
+	}
+#undef SMB_ADDR
+}
+
+/*
+ * Control words queued while the byte before is in progress, a random read
+ * of the small memory with the repeated start and the final lone stop taken
+ * over straight from the acknowledge. Then a ctrl write while the sequencer
+ * runs, which is dropped and flagged by the overflow bit.
+ */
+void test_chain(int chan)
+{
+	const uint32_t ctrl_addr = i2c_ctrl_addr + chan * i2c_chan_stride;
+	const uint32_t status_addr = i2c_status_addr + chan * i2c_chan_stride;
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	const uint8_t mem_addr = 5;
+	uint8_t data = rand();
 	uint32_t status;
-	/* Make sure interface is not busy */
-	while (axi_master_read(i2c_status_addr) & i2c_status_busy_bit);
 
-	/* Address for write mode */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 0 << 0);
+	assert(i2c_mem_write(chan, I2C_ADDR, mem_addr, data) == 0);
+
+	/* Address for write mode with the memory address queued behind it */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1);
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+
+	/* Repeated start, address for read mode */
+	while (axi_master_read(status_addr) & i2c_status_pending_bit);
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 1 << 0);
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit);
-	assert(status & i2c_status_ack_bit && "I2C (write) address ACK");
+	/* Data, NACK but no stop */
+	while (axi_master_read(status_addr) & i2c_status_pending_bit);
+	axi_master_write(ctrl_addr, i2c_ctrl_nack_bit);
 
-	/* Memory address */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+	/* Stop only */
+	while (axi_master_read(status_addr) & i2c_status_pending_bit);
+	axi_master_write(ctrl_addr, i2c_ctrl_stop_only_bit);
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit);
-	assert(status & i2c_status_ack_bit && "MEM address ACK");
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	assert((status & 0xff) == data);
+	assert(!(status & i2c_status_overflow_bit));
+
+	/* One byte page write to the 24C02 with ACK polling, busy for the write cycle */
+	axi_master_write(i2c_seq_data_addr + chan * i2c_chan_stride, data);
+	axi_master_write(i2c_seq_cmd_addr + chan * i2c_chan_stride,
+	                 i2c_seq_cmd_page_write_bit | i2c_seq_cmd_poll_bit | mem_addr << 8 | 0x50);
+	axi_master_write(ctrl_addr, i2c_ctrl_stop_only_bit);
+
+	/* Only dropped if the sequence was still running, then read clears it */
+	if (axi_master_read(i2c_seq_status_addr + chan * i2c_chan_stride) & i2c_seq_status_busy_bit) {
+		assert(axi_master_read(status_addr) & i2c_status_overflow_bit);
+		assert(!(axi_master_read(status_addr) & i2c_status_overflow_bit));
+	}
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+}
 
-	/* Address for read mode */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 1 << 0);
+/*
+ * Abort in the middle of a read of zeros, which leaves the slave driving SDA
+ * low, the bus recovery has to clock it out before the memory can be read
+ * again.
+ */
+void test_abort(int chan)
+{
+	const uint32_t ctrl_addr = i2c_ctrl_addr + chan * i2c_chan_stride;
+	const uint32_t status_addr = i2c_status_addr + chan * i2c_chan_stride;
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	const uint8_t mem_addr = 8;
+	uint8_t data = rand();
+	uint32_t status;
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit);
-	assert(status & i2c_status_ack_bit && "I2C (read) address ACK");
+	for (int i = 0; i < 3; i++) {
+		assert(i2c_mem_write(chan, I2C_ADDR, mem_addr + i, 0x00) == 0);
+	}
+	assert(i2c_mem_write(chan, I2C_ADDR, mem_addr + 3, data) == 0);
+
+	/* Random read, abandoned in the middle of the data */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1);
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+	while (axi_master_read(status_addr) & i2c_status_pending_bit);
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 1 << 0);
+	while (axi_master_read(status_addr) & i2c_status_pending_bit);
+	axi_master_write(ctrl_addr, 0);
+	while (axi_master_read(status_addr) & i2c_status_pending_bit);
+	axi_master_write(ctrl_addr, 0);
+
+	axi_master_write(i2c_abort_addr + chan * i2c_chan_stride, 1);
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	assert(!(status & i2c_status_stuck_bit));
+
+	assert(i2c_mem_read(chan, I2C_ADDR, mem_addr) == 0x00);
+	assert(i2c_mem_read(chan, I2C_ADDR, mem_addr + 3) == data);
+}
 
-	/* Memory data */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_stop_bit);
+/*
+ * Address probes on one channel, each completion taken from the IRQ message
+ * on the async socket and acknowledged, like an interrupt driven driver does.
+ * The simulator reports the IRQ to ack latency when it exits.
+ */
+void test_irq(int chan, int iterations)
+{
+	const uint32_t ctrl_addr = i2c_ctrl_addr + chan * i2c_chan_stride;
+	const uint32_t status_addr = i2c_status_addr + chan * i2c_chan_stride;
+	struct pollfd pfd = {.fd = axi_master_socket_async, .events = POLLIN};
+	struct axi_master_irq_msg irq_msg;
+	uint32_t seq = 0;
+
+	/* Forget about IRQs raised by earlier tests, nobody acked them */
+	axi_master_write(i2c_irq_cause_addr, ~0u);
+	while (recv(axi_master_socket_async, &irq_msg, sizeof(irq_msg), MSG_DONTWAIT) == sizeof(irq_msg));
+
+	for (int n = 0; n < iterations; n++) {
+		axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_ctrl_stop_bit | I2C_ADDR << 1);
+
+		/* The simulation only runs on bus accesses once the controller is idle */
+		do {
+			if (poll(&pfd, 1, 1) != 1) {
+				(void)axi_master_read(i2c_irq_cause_addr);
+				continue;
+			}
+			if (recv(axi_master_socket_async, &irq_msg, sizeof(irq_msg), MSG_WAITALL) != sizeof(irq_msg)) {
+				perror("recv async");
+				exit(1);
+			}
+			client_stats.irq_msgs++;
+			client_stats.irq_raised += irq_msg.level;
+		} while (!irq_msg.level);
+
+		assert(irq_msg.seq > seq && "IRQ sequence number");
+		seq = irq_msg.seq;
+
+		assert(axi_master_read(status_addr) & i2c_status_ack_bit && "I2C address ACK");
+		axi_master_write(i2c_irq_ack_addr + chan * i2c_chan_stride, 1);
+	}
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit);
-	assert(status & i2c_status_ack_bit && "MEM read ACK");
+	printf("IRQ test: %d IRQs, last at sim time %llu\n", iterations, (unsigned long long)irq_msg.sim_time);
+}
 
-	return status & 0xff;
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-b] [-s socket] [-r seed] [-d scope,depth] [-t nack|address] [-w clocks]\n", prog);
+	fprintf(stderr, "  -b         read and write the full 32KiB EEPROMs\n");
+	fprintf(stderr, "  -s socket  simulator socket path (default $" SOCK_PATH_ENV " or " SOCK_PATH ")\n");
+	fprintf(stderr, "  -r seed    seed for the test data\n");
+	fprintf(stderr, "  -d s,d     waveform scope bits and depth (0 all levels), dump from the start unless -t\n");
+	fprintf(stderr, "  -t trig    start dumping on the first NACK or access to the AXI address\n");
+	fprintf(stderr, "  -w clocks  dump window after the trigger (default until the end)\n");
+	exit(2);
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
     struct sockaddr_un remote;
+    const char *sock_path = axi_master_sock_path();
+    int bench = 0;
+    int opt;
+    const char *dump_scope = NULL;
+    const char *dump_trig = NULL;
+    uint32_t dump_window = 0;
+
+    while ((opt = getopt(argc, argv, "bs:r:d:t:w:")) != -1) {
+        switch (opt) {
+        case 'b':
+            bench = 1;
+            break;
+        case 's':
+            sock_path = optarg;
+            break;
+        case 'r':
+            srand(strtoul(optarg, NULL, 0));
+            break;
+        case 'd':
+            dump_scope = optarg;
+            break;
+        case 't':
+            dump_trig = optarg;
+            break;
+        case 'w':
+            dump_window = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
 
     if ((axi_master_socket_sync = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
         perror("socket");
@@ -144,18 +516,41 @@ int main(void)
     printf("Trying to connect...\n");
 
 	remote.sun_family = AF_UNIX;
-	snprintf(remote.sun_path, 104, "%s.%s", SOCK_PATH, "sync");
+	snprintf(remote.sun_path, 104, "%s.%s", sock_path, "sync");
 	if (connect(axi_master_socket_sync, (struct sockaddr *)&remote, sizeof(remote)) == -1) {
 		perror("connect sync");
 		exit(1);
 	}
-	snprintf(remote.sun_path, 104, "%s.%s", SOCK_PATH, "async");
+	snprintf(remote.sun_path, 104, "%s.%s", sock_path, "async");
 	if (connect(axi_master_socket_async, (struct sockaddr *)&remote, sizeof(remote)) == -1) {
 		perror("connect async");
 		exit(1);
 	}
 
     printf("Connected.\n");
+	connect_ns = now_ns();
+
+	if (dump_scope || dump_trig) {
+		unsigned scope = DUMP_SCOPE_TB, depth = 0;
+
+		if (dump_scope && sscanf(dump_scope, "%i,%i", &scope, &depth) < 1) {
+			usage(argv[0]);
+		}
+
+		if (!dump_trig) {
+			axi_master_dump(DUMP_CMD_START, depth << 8 | scope);
+		}
+		else {
+			axi_master_dump(DUMP_CMD_SCOPE, depth << 8 | scope);
+			axi_master_dump(DUMP_CMD_WINDOW, dump_window);
+			if (!strcmp(dump_trig, "nack")) {
+				axi_master_dump(DUMP_CMD_TRIG_NACK, 0);
+			}
+			else {
+				axi_master_dump(DUMP_CMD_TRIG_ADDR, strtoul(dump_trig, NULL, 0));
+			}
+		}
+	}
 
 	/* begin - test */
 
@@ -168,33 +563,36 @@ int main(void)
 	printf("data: %x\n", axi_master_read(0x00001000));
 	printf("data: %x\n", axi_master_read(0x00001008));
 
-	/* I2C slave model has address 7'b001_0000 */
-#define I2C_ADDR 0x10
-#define DATA_SIZE 16
-	uint8_t data[DATA_SIZE];
+#define MAX_CHANNELS 15
+	int num_chan = axi_master_read(i2c_num_chan_addr);
 
-	/* Generate reference data */
-	for (int i = 0; i < DATA_SIZE; i++) {
-		data[i] = rand();
-	}
+	printf("channels: %d\n", num_chan);
+	assert(num_chan >= 1 && num_chan <= MAX_CHANNELS);
 
-	/* Write data to memory in forward order */
-	for (int i = 0; i < DATA_SIZE; i++) {
-		i2c_mem_write(I2C_ADDR, i, data[i]);
+	/* Small memory on the first channel, 24C256 on the second */
+	test_small(0);
+	if (num_chan > 1) {
+		test_eeprom(1, bench);
 	}
 
-	/* Read data from memory (and verify) in forward order */
-	for (int i = 0; i < DATA_SIZE; i++) {
-		assert(i2c_mem_read(I2C_ADDR, i) == data[i]);
-	}
+	test_stress(num_chan, bench ? 2000 : 100);
 
-	/* Read data from memory (and verify) in reverse order */
-	for (int i = 0; i < DATA_SIZE; i++) {
-		assert(i2c_mem_read(I2C_ADDR, DATA_SIZE - 1 - i) == data[DATA_SIZE - 1 - i]);
+	test_smbus(0);
+
+	test_chain(0);
+
+	test_abort(0);
+
+	test_irq(0, bench ? 1000 : 50);
+
+	for (int c = 0; c < num_chan; c++) {
+		i2c_perf_report(c);
 	}
 
 	/* end - test */
 
+	axi_master_send_stats();
+
     close(axi_master_socket_sync);
     close(axi_master_socket_async);
 
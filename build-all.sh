@@ -4,7 +4,11 @@ set -x -e
 
 ./compile.sh
 
-iverilog-vpi vpi_axi_master.c
+iverilog-vpi vpi_axi_master.c vpi_i2c_monitor.c vpi_util.c
 
-gcc -Wall -Werror axi_master_client.c -o axi_master_client
+gcc -Wall -Werror axi_master_client.c i2c_mem.c -o axi_master_client
+
+# Userspace library for use with the UIO kernel module
+gcc -Wall -Werror -c i2c_mem.c i2c_uio.c
+ar rcs libi2c_uio.a i2c_mem.o i2c_uio.o
 
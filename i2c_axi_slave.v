@@ -1,7 +1,8 @@
 module i2c_axi_slave #
 (
 	parameter integer C_S_AXI_DATA_WIDTH = 32,
-	parameter integer C_S_AXI_ADDR_WIDTH = 13
+	parameter integer C_S_AXI_ADDR_WIDTH = 13,
+	parameter integer C_NUM_CHANNELS = 1
 )
 (
 	input wire  S_AXI_ACLK,
@@ -26,10 +27,26 @@ module i2c_axi_slave #
 	output wire  S_AXI_RVALID,
 	input wire  S_AXI_RREADY,
 
-	output wire i2c_cmd_pulse_o,
-	output wire i2c_irq_ack_pulse_o,
-	output wire[10:0] i2c_ctrl_reg_o,
-	input wire[9:0] i2c_status_reg_i
+	output wire[C_NUM_CHANNELS-1:0] i2c_cmd_pulse_o,
+	output wire[C_NUM_CHANNELS-1:0] i2c_irq_ack_pulse_o,
+	output wire[C_NUM_CHANNELS*13-1:0] i2c_ctrl_reg_o,
+	input wire[C_NUM_CHANNELS*13-1:0] i2c_status_reg_i,
+	output wire[C_NUM_CHANNELS-1:0] i2c_status_rd_pulse_o,
+	output wire[C_NUM_CHANNELS-1:0] i2c_abort_pulse_o,
+	input wire[C_NUM_CHANNELS-1:0] i2c_irq_i,
+
+	output wire[C_NUM_CHANNELS-1:0] i2c_seq_cmd_pulse_o,
+	output wire[C_NUM_CHANNELS*29-1:0] i2c_seq_cmd_o,
+	output wire[C_NUM_CHANNELS-1:0] i2c_seq_data_pulse_o,
+	output wire[C_NUM_CHANNELS*8-1:0] i2c_seq_data_o,
+	output wire[C_NUM_CHANNELS-1:0] i2c_seq_rdata_pulse_o,
+	input wire[C_NUM_CHANNELS*8-1:0] i2c_seq_rdata_i,
+	input wire[C_NUM_CHANNELS*32-1:0] i2c_seq_status_i,
+
+	output wire[C_NUM_CHANNELS-1:0] i2c_perf_ctrl_pulse_o,
+	output wire[C_NUM_CHANNELS*2-1:0] i2c_perf_ctrl_o,
+	output wire[3:0] i2c_perf_sel_o,
+	input wire[C_NUM_CHANNELS*32-1:0] i2c_perf_data_i
 );
 
 	reg [C_S_AXI_ADDR_WIDTH-1 : 0] axi_awaddr;
@@ -43,18 +60,11 @@ module i2c_axi_slave #
 	reg [1 : 0] axi_rresp;
 	reg axi_rvalid;
 
-	reg [C_S_AXI_DATA_WIDTH-1 : 0] slv_reg_a;
-	reg [C_S_AXI_DATA_WIDTH-1 : 0] slv_reg_b;
-	reg [C_S_AXI_DATA_WIDTH-1 : 0] slv_reg_c;
-	reg [10:0] slv_reg_i2c_ctrl;
-
 	wire slv_reg_rden;
 	wire slv_reg_wren;
 	reg [C_S_AXI_DATA_WIDTH-1:0] reg_data_out;
-	reg i2c_cmd_pulse;
-	reg i2c_irq_ack_pulse;
-
-	assign i2c_ctrl_reg_o = slv_reg_i2c_ctrl;
+	wire [C_NUM_CHANNELS*C_S_AXI_DATA_WIDTH-1:0] chan_reg_data_out;
+	wire [C_NUM_CHANNELS*C_S_AXI_DATA_WIDTH-1:0] wait_timeout;
 
 	assign S_AXI_AWREADY = axi_awready;
 	assign S_AXI_WREADY = axi_wready;
@@ -108,49 +118,195 @@ module i2c_axi_slave #
 
 	assign slv_reg_wren = axi_wready && S_AXI_WVALID && axi_awready && S_AXI_AWVALID;
 
-	always @( posedge S_AXI_ACLK) begin
-		if (S_AXI_ARESETN == 1'b0) begin
-			slv_reg_a <= 0;
-			slv_reg_b <= 0;
-			slv_reg_c <= 0;
-		end
-		else begin
-			if (slv_reg_wren && axi_awaddr[12:0] == 13'h1000) begin
-				slv_reg_a <= S_AXI_WDATA;
+	// Register map
+	//
+	// Each channel has its own register bank, channel n is located at
+	// 0x1000 + n * 0x100. The topmost slot (0x1f00) is not a channel but holds
+	// the registers shared by all channels, hence at most 15 channels.
+	//
+	//   bank + 0x000  scratch a
+	//   bank + 0x004  scratch b
+	//   bank + 0x008  scratch c
+	//   bank + 0x00c  i2c ctrl, written while a byte is in progress it is
+	//                 queued and started right after it (one deep)
+	//   bank + 0x010  i2c status (read only), bit 10 is set while a ctrl
+	//                 word is queued, bit 11 (sticky) when a ctrl write was
+	//                 dropped because the queue was full or the sequencer
+	//                 was running. Bit 11 is cleared by reading this
+	//                 register or by an irq ack. Bit 12 is set when the last
+	//                 abort gave up on a bus with SCL held low
+	//   bank + 0x014  i2c status, wait for idle (read only). The read is not
+	//                 answered until the channel is idle or the wait timeout
+	//                 expires, bit 31 is set in the latter case
+	//   bank + 0x018  wait timeout in clock cycles, 0 waits forever
+	//   bank + 0x01c  abort (write only), drops the transfer in progress and
+	//                 recovers the bus with up to 9 SCL pulses and a stop
+	//   bank + 0x020  irq ack (write only)
+	//   bank + 0x024  sequencer command (writing starts the sequence)
+	//   bank + 0x028  sequencer data, a write pushes a byte to the page buffer,
+	//                 a read pops one (data of an SMBus block read)
+	//   bank + 0x02c  sequencer status (read only)
+	//   bank + 0x030  performance counter control (write only)
+	//   bank + 0x080  performance counter snapshots, 16 registers (read only)
+	//
+	//   0x1f00        irq cause, one bit per channel (write one to ack)
+	//   0x1f04        number of channels (read only)
+
+	wire glb_wr_sel;
+	assign glb_wr_sel = slv_reg_wren && axi_awaddr[12:8] == 5'h1f;
+
+	// The read address picks the performance counter in all channels
+	assign i2c_perf_sel_o = axi_araddr[5:2];
+
+	genvar i;
+	generate
+	for (i = 0; i < C_NUM_CHANNELS; i = i + 1) begin : g_chan
+		reg [C_S_AXI_DATA_WIDTH-1 : 0] slv_reg_a;
+		reg [C_S_AXI_DATA_WIDTH-1 : 0] slv_reg_b;
+		reg [C_S_AXI_DATA_WIDTH-1 : 0] slv_reg_c;
+		reg [12:0] slv_reg_i2c_ctrl;
+		reg [28:0] slv_reg_seq_cmd;
+		reg [7:0] slv_reg_seq_data;
+		reg [1:0] slv_reg_perf_ctrl;
+		reg [C_S_AXI_DATA_WIDTH-1 : 0] slv_reg_wait_timeout;
+		reg [C_S_AXI_DATA_WIDTH-1 : 0] bank_data_out;
+		reg i2c_cmd_pulse;
+		reg i2c_abort_pulse;
+		reg i2c_irq_ack_pulse;
+		reg i2c_seq_cmd_pulse;
+		reg i2c_seq_data_pulse;
+		reg i2c_perf_ctrl_pulse;
+
+		wire wr_sel;
+		assign wr_sel = slv_reg_wren && axi_awaddr[12:8] == 5'h10 + i;
+
+		assign i2c_ctrl_reg_o[i*13 +: 13] = slv_reg_i2c_ctrl;
+		assign i2c_seq_cmd_o[i*29 +: 29] = slv_reg_seq_cmd;
+		assign i2c_seq_data_o[i*8 +: 8] = slv_reg_seq_data;
+		assign i2c_perf_ctrl_o[i*2 +: 2] = slv_reg_perf_ctrl;
+		assign wait_timeout[i*C_S_AXI_DATA_WIDTH +: C_S_AXI_DATA_WIDTH] = slv_reg_wait_timeout;
+
+		always @( posedge S_AXI_ACLK) begin
+			if (S_AXI_ARESETN == 1'b0) begin
+				slv_reg_a <= 0;
+				slv_reg_b <= 0;
+				slv_reg_c <= 0;
+				slv_reg_i2c_ctrl <= 0;
+				slv_reg_seq_cmd <= 0;
+				slv_reg_seq_data <= 0;
+				slv_reg_perf_ctrl <= 0;
+				slv_reg_wait_timeout <= 32'h000f_ffff;
 			end
-			if (slv_reg_wren && axi_awaddr[12:0] == 13'h1004) begin
-				slv_reg_b <= S_AXI_WDATA;
+			else begin
+				if (wr_sel && axi_awaddr[7:0] == 8'h00) begin
+					slv_reg_a <= S_AXI_WDATA;
+				end
+				if (wr_sel && axi_awaddr[7:0] == 8'h04) begin
+					slv_reg_b <= S_AXI_WDATA;
+				end
+				if (wr_sel && axi_awaddr[7:0] == 8'h08) begin
+					slv_reg_c <= S_AXI_WDATA;
+				end
+				if (wr_sel && axi_awaddr[7:0] == 8'h0c) begin
+					slv_reg_i2c_ctrl <= S_AXI_WDATA[12:0];
+				end
+				if (wr_sel && axi_awaddr[7:0] == 8'h24) begin
+					slv_reg_seq_cmd <= S_AXI_WDATA[28:0];
+				end
+				if (wr_sel && axi_awaddr[7:0] == 8'h28) begin
+					slv_reg_seq_data <= S_AXI_WDATA[7:0];
+				end
+				if (wr_sel && axi_awaddr[7:0] == 8'h30) begin
+					slv_reg_perf_ctrl <= S_AXI_WDATA[1:0];
+				end
+				if (wr_sel && axi_awaddr[7:0] == 8'h18) begin
+					slv_reg_wait_timeout <= S_AXI_WDATA;
+				end
 			end
-			if (slv_reg_wren && axi_awaddr[12:0] == 13'h1008) begin
-				slv_reg_c <= S_AXI_WDATA;
+		end
+
+		assign i2c_cmd_pulse_o[i] = i2c_cmd_pulse;
+
+		always @( posedge S_AXI_ACLK ) begin
+			if ( S_AXI_ARESETN == 1'b0 ) begin
+				i2c_cmd_pulse <= 0;
 			end
-			if (slv_reg_wren && axi_awaddr[12:0] == 13'h100c) begin
-				slv_reg_i2c_ctrl <= S_AXI_WDATA[10:0];
+			else begin
+				i2c_cmd_pulse <= wr_sel && axi_awaddr[7:0] == 8'h0c;
 			end
 		end
-	end
 
-	assign i2c_cmd_pulse_o = i2c_cmd_pulse;
+		assign i2c_abort_pulse_o[i] = i2c_abort_pulse;
 
-	always @( posedge S_AXI_ACLK ) begin
-		if ( S_AXI_ARESETN == 1'b0 ) begin
-			i2c_cmd_pulse <= 0;
+		always @( posedge S_AXI_ACLK ) begin
+			if ( S_AXI_ARESETN == 1'b0 ) begin
+				i2c_abort_pulse <= 0;
+			end
+			else begin
+				i2c_abort_pulse <= wr_sel && axi_awaddr[7:0] == 8'h1c;
+			end
 		end
-		else begin
-			i2c_cmd_pulse <= slv_reg_wren && axi_awaddr[12:0] == 13'h100c;
+
+		assign i2c_irq_ack_pulse_o[i] = i2c_irq_ack_pulse;
+
+		always @( posedge S_AXI_ACLK ) begin
+			if ( S_AXI_ARESETN == 1'b0 ) begin
+				i2c_irq_ack_pulse <= 0;
+			end
+			else begin
+				i2c_irq_ack_pulse <= (wr_sel && axi_awaddr[7:0] == 8'h20) ||
+				                     (glb_wr_sel && axi_awaddr[7:0] == 8'h00 && S_AXI_WDATA[i]);
+			end
 		end
-	end
 
-	assign i2c_irq_ack_pulse_o = i2c_irq_ack_pulse;
+		assign i2c_seq_cmd_pulse_o[i] = i2c_seq_cmd_pulse;
 
-	always @( posedge S_AXI_ACLK ) begin
-		if ( S_AXI_ARESETN == 1'b0 ) begin
-			i2c_irq_ack_pulse <= 0;
+		// Clears the overflow bit after the read data has latched it
+		assign i2c_status_rd_pulse_o[i] = slv_reg_rden && axi_araddr[12:8] == 5'h10 + i && axi_araddr[7:0] == 8'h10;
+
+		// Pops the byte that is latched into the read data on the same clock
+		assign i2c_seq_rdata_pulse_o[i] = slv_reg_rden && axi_araddr[12:8] == 5'h10 + i && axi_araddr[7:0] == 8'h28;
+		assign i2c_seq_data_pulse_o[i] = i2c_seq_data_pulse;
+		assign i2c_perf_ctrl_pulse_o[i] = i2c_perf_ctrl_pulse;
+
+		always @( posedge S_AXI_ACLK ) begin
+			if ( S_AXI_ARESETN == 1'b0 ) begin
+				i2c_seq_cmd_pulse <= 0;
+				i2c_seq_data_pulse <= 0;
+				i2c_perf_ctrl_pulse <= 0;
+			end
+			else begin
+				i2c_seq_cmd_pulse <= wr_sel && axi_awaddr[7:0] == 8'h24;
+				i2c_seq_data_pulse <= wr_sel && axi_awaddr[7:0] == 8'h28;
+				i2c_perf_ctrl_pulse <= wr_sel && axi_awaddr[7:0] == 8'h30;
+			end
 		end
-		else begin
-			i2c_irq_ack_pulse <= slv_reg_wren && axi_awaddr[12:0] == 13'h1020;
+
+		// Address decoding for reading registers within the bank
+		always @* begin
+			if (axi_araddr[7:6] == 2'b10) begin
+				bank_data_out <= i2c_perf_data_i[i*32 +: 32];
+			end
+			else begin
+				case ( axi_araddr[7:0] )
+					8'h00: bank_data_out <= slv_reg_a;
+					8'h04: bank_data_out <= slv_reg_b;
+					8'h08: bank_data_out <= slv_reg_c;
+					8'h0c: bank_data_out <= slv_reg_i2c_ctrl;
+					8'h10: bank_data_out <= i2c_status_reg_i[i*13 +: 13];
+					8'h14: bank_data_out <= i2c_status_reg_i[i*13 +: 13];
+					8'h18: bank_data_out <= slv_reg_wait_timeout;
+					8'h24: bank_data_out <= slv_reg_seq_cmd;
+					8'h28: bank_data_out <= i2c_seq_rdata_i[i*8 +: 8];
+					8'h2c: bank_data_out <= i2c_seq_status_i[i*32 +: 32];
+					default : bank_data_out <= 0;
+				endcase
+			end
 		end
+
+		assign chan_reg_data_out[i*C_S_AXI_DATA_WIDTH +: C_S_AXI_DATA_WIDTH] = bank_data_out;
 	end
+	endgenerate
 
 	// Implement write response logic generation
 	always @( posedge S_AXI_ACLK ) begin
@@ -172,6 +328,41 @@ module i2c_axi_slave #
 		end
 	end
 
+	// Wait for idle reads, the response is held back while the addressed
+	// channel is busy and its timeout has not expired
+	reg rd_wait;
+	reg [C_S_AXI_DATA_WIDTH-1 : 0] rd_wait_cnt;
+	wire rd_wait_sel;
+	wire rd_wait_busy;
+	wire [C_S_AXI_DATA_WIDTH-1 : 0] rd_wait_timeout;
+	wire rd_wait_expired;
+	wire rd_wait_done;
+
+	assign rd_wait_sel = axi_araddr[12] && axi_araddr[11:8] < C_NUM_CHANNELS && axi_araddr[7:0] == 8'h14;
+	assign rd_wait_busy = i2c_status_reg_i[axi_araddr[11:8]*13 + 9];
+	assign rd_wait_timeout = wait_timeout[axi_araddr[11:8]*C_S_AXI_DATA_WIDTH +: C_S_AXI_DATA_WIDTH];
+	assign rd_wait_expired = rd_wait_timeout != 0 && rd_wait_cnt >= rd_wait_timeout;
+	assign rd_wait_done = rd_wait && (!rd_wait_busy || rd_wait_expired);
+
+	always @( posedge S_AXI_ACLK ) begin
+		if ( S_AXI_ARESETN == 1'b0 ) begin
+			rd_wait <= 0;
+			rd_wait_cnt <= 0;
+		end
+		else begin
+			if (slv_reg_rden && rd_wait_sel) begin
+				rd_wait <= 1;
+				rd_wait_cnt <= 0;
+			end
+			else if (rd_wait_done) begin
+				rd_wait <= 0;
+			end
+			else if (rd_wait) begin
+				rd_wait_cnt <= rd_wait_cnt + 1;
+			end
+		end
+	end
+
 	// Implement axi_arready generation
 	always @( posedge S_AXI_ACLK ) begin
 		if ( S_AXI_ARESETN == 1'b0 ) begin
@@ -179,7 +370,7 @@ module i2c_axi_slave #
 			axi_araddr  <= 32'b0;
 		end
 		else begin
-			if (~axi_arready && S_AXI_ARVALID) begin
+			if (~axi_arready && S_AXI_ARVALID && ~rd_wait) begin
 				axi_arready <= 1'b1;
 				axi_araddr  <= S_AXI_ARADDR;
 			end
@@ -196,7 +387,7 @@ module i2c_axi_slave #
 			axi_rresp  <= 0;
 		end
 		else begin
-			if (axi_arready && S_AXI_ARVALID && ~axi_rvalid) begin
+			if ((axi_arready && S_AXI_ARVALID && ~axi_rvalid && ~rd_wait_sel) || rd_wait_done) begin
 				// Valid read data is available at the read data bus
 				axi_rvalid <= 1'b1;
 				axi_rresp  <= 2'b0; // 'OKAY' response
@@ -216,14 +407,19 @@ module i2c_axi_slave #
 		end
 		else begin
 			// Address decoding for reading registers
-			case ( axi_araddr[12:0] )
-				13'h1000: reg_data_out <= slv_reg_a;
-				13'h1004: reg_data_out <= slv_reg_b;
-				13'h1008: reg_data_out <= slv_reg_c;
-				13'h100c: reg_data_out <= slv_reg_i2c_ctrl;
-				13'h1010: reg_data_out <= i2c_status_reg_i;
-				default : reg_data_out <= 0;
-			endcase
+			if (axi_araddr[12:8] == 5'h1f) begin
+				case ( axi_araddr[7:0] )
+					8'h00: reg_data_out <= i2c_irq_i;
+					8'h04: reg_data_out <= C_NUM_CHANNELS;
+					default : reg_data_out <= 0;
+				endcase
+			end
+			else if (axi_araddr[12] && axi_araddr[11:8] < C_NUM_CHANNELS) begin
+				reg_data_out <= chan_reg_data_out[axi_araddr[11:8]*C_S_AXI_DATA_WIDTH +: C_S_AXI_DATA_WIDTH];
+			end
+			else begin
+				reg_data_out <= 0;
+			end
 		end
 	end
 
@@ -233,9 +429,12 @@ module i2c_axi_slave #
 			axi_rdata <= 0;
 		end
 		else begin
-			if (slv_reg_rden) begin
+			if (slv_reg_rden && ~rd_wait_sel) begin
 				axi_rdata <= reg_data_out;
 			end
+			else if (rd_wait_done) begin
+				axi_rdata <= {rd_wait_busy, reg_data_out[C_S_AXI_DATA_WIDTH-2 : 0]};
+			end
 		end
 	end
 
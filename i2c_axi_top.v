@@ -1,6 +1,7 @@
 module i2c_axi_top #(
   parameter integer C_S00_AXI_DATA_WIDTH = 32,
-  parameter integer C_S00_AXI_ADDR_WIDTH = 13
+  parameter integer C_S00_AXI_ADDR_WIDTH = 13,
+  parameter integer C_NUM_CHANNELS = 1
 )
 (
   /* AXI interface */
@@ -28,10 +29,11 @@ module i2c_axi_top #(
 
   output wire busy_bit_o,
   output wire i2c_irq_o,
+  output wire [C_NUM_CHANNELS-1 : 0] i2c_irq_vec_o,
 
-  /* I2C interface */
-  output wire I2C_SCL_O,
-  inout wire I2C_SDA_IO
+  /* I2C interface, one bus per channel */
+  inout wire [C_NUM_CHANNELS-1 : 0] I2C_SCL_IO,
+  inout wire [C_NUM_CHANNELS-1 : 0] I2C_SDA_IO
 );
 	wire clk;
 	wire rst;
@@ -39,19 +41,33 @@ module i2c_axi_top #(
 	assign clk = S00_AXI_aclk;
 	assign rst = ~S00_AXI_aresetn;
 
-	wire i2c_cmd_pulse;
-	wire i2c_irq_ack_pulse;
-	wire[10:0] i2c_ctrl_reg;
-	wire[9:0] i2c_status_reg;
+	wire[C_NUM_CHANNELS-1:0] i2c_cmd_pulse;
+	wire[C_NUM_CHANNELS-1:0] i2c_irq_ack_pulse;
+	wire[C_NUM_CHANNELS*13-1:0] i2c_ctrl_reg;
+	wire[C_NUM_CHANNELS*13-1:0] i2c_status_reg;
+	wire[C_NUM_CHANNELS-1:0] i2c_status_rd_pulse;
+	wire[C_NUM_CHANNELS-1:0] i2c_abort_pulse;
+	wire[C_NUM_CHANNELS-1:0] i2c_seq_cmd_pulse;
+	wire[C_NUM_CHANNELS*29-1:0] i2c_seq_cmd;
+	wire[C_NUM_CHANNELS-1:0] i2c_seq_data_pulse;
+	wire[C_NUM_CHANNELS*8-1:0] i2c_seq_data;
+	wire[C_NUM_CHANNELS-1:0] i2c_seq_rdata_pulse;
+	wire[C_NUM_CHANNELS*8-1:0] i2c_seq_rdata;
+	wire[C_NUM_CHANNELS*32-1:0] i2c_seq_status;
+	wire[C_NUM_CHANNELS-1:0] i2c_perf_ctrl_pulse;
+	wire[C_NUM_CHANNELS*2-1:0] i2c_perf_ctrl;
+	wire[3:0] i2c_perf_sel;
+	wire[C_NUM_CHANNELS*32-1:0] i2c_perf_data;
+	wire[C_NUM_CHANNELS-1:0] i2c_busy;
 
-	wire i2c_sda_o;
-	wire i2c_sda_oe;
-
-	assign I2C_SDA_IO = i2c_sda_oe ? i2c_sda_o : 1'bz;
+	wire[C_NUM_CHANNELS-1:0] i2c_scl_o;
+	wire[C_NUM_CHANNELS-1:0] i2c_sda_o;
+	wire[C_NUM_CHANNELS-1:0] i2c_sda_oe;
 
 	i2c_axi_slave # (
 	  .C_S_AXI_DATA_WIDTH(C_S00_AXI_DATA_WIDTH),
-	  .C_S_AXI_ADDR_WIDTH(C_S00_AXI_ADDR_WIDTH))
+	  .C_S_AXI_ADDR_WIDTH(C_S00_AXI_ADDR_WIDTH),
+	  .C_NUM_CHANNELS(C_NUM_CHANNELS))
 	u_i2c_axi_slave (
 	  .S_AXI_ACLK(S00_AXI_aclk),
 	  .S_AXI_ARESETN(S00_AXI_aresetn),
@@ -78,28 +94,75 @@ module i2c_axi_top #(
 	  .i2c_irq_ack_pulse_o(i2c_irq_ack_pulse),
 	  .i2c_cmd_pulse_o(i2c_cmd_pulse),
 	  .i2c_ctrl_reg_o(i2c_ctrl_reg),
-	  .i2c_status_reg_i(i2c_status_reg)
+	  .i2c_status_reg_i(i2c_status_reg),
+	  .i2c_status_rd_pulse_o(i2c_status_rd_pulse),
+	  .i2c_abort_pulse_o(i2c_abort_pulse),
+	  .i2c_irq_i(i2c_irq_vec_o),
+
+	  .i2c_seq_cmd_pulse_o(i2c_seq_cmd_pulse),
+	  .i2c_seq_cmd_o(i2c_seq_cmd),
+	  .i2c_seq_data_pulse_o(i2c_seq_data_pulse),
+	  .i2c_seq_data_o(i2c_seq_data),
+	  .i2c_seq_rdata_pulse_o(i2c_seq_rdata_pulse),
+	  .i2c_seq_rdata_i(i2c_seq_rdata),
+	  .i2c_seq_status_i(i2c_seq_status),
+
+	  .i2c_perf_ctrl_pulse_o(i2c_perf_ctrl_pulse),
+	  .i2c_perf_ctrl_o(i2c_perf_ctrl),
+	  .i2c_perf_sel_o(i2c_perf_sel),
+	  .i2c_perf_data_i(i2c_perf_data)
 	);
 
-	i2c_controller # (
-	  .C_CLK_DIVIDER_LOG2(2))
-	u_i2c_controller (
-	  .clk(clk),
-	  .rst(rst),
+	genvar i;
+	generate
+	for (i = 0; i < C_NUM_CHANNELS; i = i + 1) begin : g_chan
+		// SCL is open drain so that slaves can stretch the clock
+		assign I2C_SCL_IO[i] = i2c_scl_o[i] ? 1'bz : 1'b0;
+		assign I2C_SDA_IO[i] = i2c_sda_oe[i] ? i2c_sda_o[i] : 1'bz;
 
-	  .i2c_cmd_pulse_i(i2c_cmd_pulse),
-	  .i2c_ctrl_reg_i(i2c_ctrl_reg),
-	  .i2c_status_reg_o(i2c_status_reg),
-	  .i2c_irq_ack_pulse_i(i2c_irq_ack_pulse),
-	  .i2c_irq_o(i2c_irq_o),
+		i2c_controller # (
+		  .C_CLK_DIVIDER_LOG2(2),
+		  .C_PAGE_SIZE_LOG2(6))
+		u_i2c_controller (
+		  .clk(clk),
+		  .rst(rst),
 
+		  .i2c_cmd_pulse_i(i2c_cmd_pulse[i]),
+		  .i2c_ctrl_reg_i(i2c_ctrl_reg[i*13 +: 13]),
+		  .i2c_status_reg_o(i2c_status_reg[i*13 +: 13]),
+		  .i2c_status_rd_pulse_i(i2c_status_rd_pulse[i]),
+		  .i2c_abort_pulse_i(i2c_abort_pulse[i]),
+		  .i2c_irq_ack_pulse_i(i2c_irq_ack_pulse[i]),
+		  .i2c_irq_o(i2c_irq_vec_o[i]),
 
-	  .I2C_SCL(I2C_SCL_O),
-	  .I2C_SDA_O(i2c_sda_o),
-	  .I2C_SDA_OE(i2c_sda_oe),
-	  .I2C_SDA_I(I2C_SDA_IO)
-	);
+		  .i2c_seq_cmd_pulse_i(i2c_seq_cmd_pulse[i]),
+		  .i2c_seq_cmd_i(i2c_seq_cmd[i*29 +: 29]),
+		  .i2c_seq_data_pulse_i(i2c_seq_data_pulse[i]),
+		  .i2c_seq_data_i(i2c_seq_data[i*8 +: 8]),
+		  .i2c_seq_rdata_pulse_i(i2c_seq_rdata_pulse[i]),
+		  .i2c_seq_rdata_o(i2c_seq_rdata[i*8 +: 8]),
+		  .i2c_seq_status_o(i2c_seq_status[i*32 +: 32]),
+
+		  .i2c_perf_ctrl_pulse_i(i2c_perf_ctrl_pulse[i]),
+		  .i2c_perf_ctrl_i(i2c_perf_ctrl[i*2 +: 2]),
+		  .i2c_perf_sel_i(i2c_perf_sel),
+		  .i2c_perf_data_o(i2c_perf_data[i*32 +: 32]),
+
+
+		  .I2C_SCL(i2c_scl_o[i]),
+		  .I2C_SCL_I(I2C_SCL_IO[i]),
+		  .I2C_SDA_O(i2c_sda_o[i]),
+		  .I2C_SDA_OE(i2c_sda_oe[i]),
+		  .I2C_SDA_I(I2C_SDA_IO[i])
+		);
+
+		assign i2c_busy[i] = i2c_status_reg[i*13 + 9];
+	end
+	endgenerate
 
-	assign busy_bit_o = i2c_status_reg[9];
+	// Channels either share one IRQ line (with the cause register in the AXI
+	// slave telling them apart) or use i2c_irq_vec_o directly
+	assign i2c_irq_o = |i2c_irq_vec_o;
+	assign busy_bit_o = |i2c_busy;
 
 endmodule
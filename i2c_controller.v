@@ -1,24 +1,55 @@
 
 module i2c_controller #
 (
-	parameter integer C_CLK_DIVIDER_LOG2 = 1
+	parameter integer C_CLK_DIVIDER_LOG2 = 1,
+	parameter integer C_PAGE_SIZE_LOG2 = 6
 )
 (
 	input wire clk,
 	input wire rst,
 
 	output wire I2C_SCL,
+	input wire  I2C_SCL_I,
 	output wire I2C_SDA_O,
 	output wire I2C_SDA_OE,
 	input wire  I2C_SDA_I,
 
 	input wire i2c_cmd_pulse_i,
-	input wire[10:0] i2c_ctrl_reg_i,
-	output wire[9:0] i2c_status_reg_o,
+	input wire[12:0] i2c_ctrl_reg_i,
+	output wire[12:0] i2c_status_reg_o,
+	input wire i2c_status_rd_pulse_i,
+	input wire i2c_abort_pulse_i,
 	input wire i2c_irq_ack_pulse_i,
-	output wire i2c_irq_o
+	output wire i2c_irq_o,
+
+	input wire i2c_seq_cmd_pulse_i,
+	input wire[28:0] i2c_seq_cmd_i,
+	input wire i2c_seq_data_pulse_i,
+	input wire[7:0] i2c_seq_data_i,
+	input wire i2c_seq_rdata_pulse_i,
+	output wire[7:0] i2c_seq_rdata_o,
+	output wire[31:0] i2c_seq_status_o,
+
+	input wire i2c_perf_ctrl_pulse_i,
+	input wire[1:0] i2c_perf_ctrl_i,
+	input wire[3:0] i2c_perf_sel_i,
+	output wire[31:0] i2c_perf_data_o
 );
 
+	wire[12:0] ctrl_reg;
+	wire cmd_pulse;
+	reg[12:0] ctrl_act;
+	reg[12:0] ctrl_pend;
+	reg ctrl_pend_vld;
+	reg ctrl_ovf;
+	reg abort_act;
+	reg[19:0] abort_stall;
+	reg[3:0] abort_pulses;
+	reg bus_stuck;
+	wire ctrl_chain;
+
+	wire ctrl_nack;
+	wire ctrl_stop_only;
 	wire ctrl_we;
 	wire ctrl_start;
 	wire ctrl_stop;
@@ -27,6 +58,7 @@ module i2c_controller #
 	wire status_busy;
 	wire status_ack;
 	wire[7:0] status_data;
+	reg[7:0] rx_data;
 
 	reg[1:0] scl_phase;
 	reg scl;
@@ -39,17 +71,59 @@ module i2c_controller #
 
 	reg i2c_irq;
 
-	assign ctrl_we    = i2c_ctrl_reg_i[10];
-	assign ctrl_start = i2c_ctrl_reg_i[9];
-	assign ctrl_stop  = i2c_ctrl_reg_i[8];
-	assign ctrl_data  = i2c_ctrl_reg_i[7:0];
+	reg[3:0] seq_state;
+	reg[12:0] seq_ctrl;
+	reg seq_cmd_pulse;
+	wire seq_busy;
+
+	// While the sequencer is running it owns the byte level FSM and commands
+	// from software are ignored
+	assign ctrl_reg  = seq_busy ? seq_ctrl : i2c_ctrl_reg_i;
+	assign cmd_pulse = seq_busy ? seq_cmd_pulse : i2c_cmd_pulse_i;
+
+	// The byte being transferred runs on its own copy of the control word.
+	// Software may write the next one while a byte is in progress, it waits
+	// in the pending slot and is started straight from S_ACK, so that bytes
+	// follow each other without going through S_IDLE and S_SYNC. Only one
+	// word is held, writes while the slot is full (or while the sequencer
+	// runs) are dropped and set the sticky overflow bit in the status.
+	assign ctrl_nack      = ctrl_act[12];
+	assign ctrl_stop_only = ctrl_act[11];
+	assign ctrl_we        = ctrl_act[10];
+	assign ctrl_start     = ctrl_act[9];
+	assign ctrl_stop      = ctrl_act[8];
+	assign ctrl_data      = ctrl_act[7:0];
+
+	assign i2c_status_reg_o = {bus_stuck, ctrl_ovf, ctrl_pend_vld, status_busy, status_ack, status_data};
+
+	// The bus lines come straight from the pads, two flops each before use
+	reg[1:0] scl_in_sync;
+	reg[1:0] sda_in_sync;
+	wire scl_in;
+	wire sda_in;
+	assign scl_in = scl_in_sync[1];
+	assign sda_in = sda_in_sync[1];
 
-	assign i2c_status_reg_o = {status_busy, status_ack, status_data};
+	always @(posedge clk) begin
+		if (rst) begin
+			scl_in_sync <= 2'b11;
+			sda_in_sync <= 2'b11;
+		end
+		else begin
+			scl_in_sync <= {scl_in_sync[0], I2C_SCL_I};
+			sda_in_sync <= {sda_in_sync[0], I2C_SDA_I};
+		end
+	end
 
 	// Derive a clock enable for a 4x SCL clock
+	//
+	// SCL is open drain, a slave holding it low while we release it (clock
+	// stretching) withholds the clock enable and thereby stalls everything
 	wire scl_4x_clk_en;
+	wire scl_stretch;
 	reg[C_CLK_DIVIDER_LOG2-1:0] clk_divider;
-	assign scl_4x_clk_en = (clk_divider == 0) ? 1 : 0;
+	assign scl_stretch = I2C_SCL && !scl_in;
+	assign scl_4x_clk_en = (clk_divider == 0 && !scl_stretch) ? 1 : 0;
 
 	always @( posedge clk ) begin
 		if (rst) begin
@@ -72,9 +146,10 @@ module i2c_controller #
 
 	// FSM for idle->start->data->ack->stop etc
 
-	parameter S_IDLE = 6'b00_0001, S_SYNC = 6'b00_0010, S_START = 6'b00_0100, S_DATA = 6'b00_1000, S_ACK = 6'b01_0000, S_STOP = 6'b10_0000;
+	parameter S_IDLE = 7'b000_0001, S_SYNC = 7'b000_0010, S_START = 7'b000_0100, S_DATA = 7'b000_1000, S_ACK = 7'b001_0000, S_STOP = 7'b010_0000,
+	          S_RECOVER = 7'b100_0000;
 
-	reg [5:0] curr_state, next_state;
+	reg [6:0] curr_state, next_state;
 
 	always @(posedge clk) begin
 		if (rst) begin
@@ -92,13 +167,14 @@ module i2c_controller #
 
 		case (curr_state)
 			S_IDLE: begin
-				if (i2c_cmd_pulse_i) begin
+				if (cmd_pulse || ctrl_pend_vld) begin
 					next_state = S_SYNC;
 				end
 			end
 			S_SYNC: begin
 				if (scl_4x_clk_en && scl_phase == 2'b11) begin
-					next_state = ctrl_start ? S_START : S_DATA;
+					next_state = ctrl_stop_only ? S_STOP :
+					             ctrl_start ? S_START : S_DATA;
 				end
 			end
 			S_START: begin
@@ -113,7 +189,10 @@ module i2c_controller #
 			end
 			S_ACK: begin
 				if (scl_4x_clk_en && scl_phase == 2'b11) begin
-					next_state = ctrl_stop ? S_STOP : S_IDLE;
+					next_state = ctrl_stop ? S_STOP :
+					             !ctrl_pend_vld ? S_IDLE :
+					             ctrl_pend[11] ? S_STOP :
+					             ctrl_pend[9] ? S_START : S_DATA;
 				end
 			end
 			S_STOP: begin
@@ -121,8 +200,21 @@ module i2c_controller #
 					next_state = S_IDLE;
 				end
 			end
+			S_RECOVER: begin
+				// Clock until the slave lets go of SDA, at most 9 times
+				if (scl_4x_clk_en && scl_phase == 2'b11 && (sda_in || abort_pulses == 4'h8)) begin
+					next_state = S_STOP;
+				end
+			end
 		endcase
 
+		if (i2c_abort_pulse_i) begin
+			next_state = S_RECOVER;
+		end
+		else if (abort_act && abort_stall == 20'hfffff) begin
+			next_state = S_IDLE;
+		end
+
 	end
 
 	reg [2:0] data_cntr;
@@ -135,14 +227,547 @@ module i2c_controller #
 		end
 	end
 
+	// Abort and bus recovery
+	//
+	// Writing the abort register drops whatever the byte level FSM, the
+	// pending slot and the sequencer are doing and recovers the bus: SDA is
+	// released and SCL clocked until a slave that still drives SDA lets go of
+	// it (at most 9 pulses, i.e. a whole byte and its acknowledge), followed
+	// by a stop. Completion raises an IRQ like a byte does. A slave holding
+	// SCL low stalls the recovery, after 2^20 clocks of that the FSM gives up,
+	// goes back to idle and sets the bus stuck bit, which is cleared by the
+	// next abort.
+	always @(posedge clk) begin
+		if (rst) begin
+			abort_act <= 0;
+			abort_stall <= 0;
+			abort_pulses <= 0;
+			bus_stuck <= 0;
+		end
+		else begin
+			if (i2c_abort_pulse_i) begin
+				abort_act <= 1;
+				abort_stall <= 0;
+				abort_pulses <= 0;
+				bus_stuck <= 0;
+			end
+			else if (abort_act) begin
+				if (next_state == S_IDLE) begin
+					abort_act <= 0;
+					bus_stuck <= abort_stall == 20'hfffff;
+				end
+				abort_stall <= scl_stretch ? abort_stall + 1 : 0;
+				if (curr_state == S_RECOVER && scl_4x_clk_en && scl_phase == 2'b11) begin
+					abort_pulses <= abort_pulses + 1;
+				end
+			end
+		end
+	end
+
+	// The pending control word takes over at the end of the acknowledge
+	assign ctrl_chain = curr_state == S_ACK && scl_4x_clk_en && scl_phase == 2'b11 &&
+	                    !ctrl_stop && ctrl_pend_vld;
+
+	always @(posedge clk) begin
+		if (rst) begin
+			ctrl_act <= 0;
+			ctrl_pend <= 0;
+			ctrl_pend_vld <= 0;
+		end
+		else begin
+			if ((curr_state == S_IDLE && ctrl_pend_vld) || ctrl_chain) begin
+				ctrl_act <= ctrl_pend;
+				ctrl_pend_vld <= 0;
+			end
+			else if (curr_state == S_IDLE && cmd_pulse) begin
+				ctrl_act <= ctrl_reg;
+			end
+
+			// Software commands while busy, the sequencer only issues
+			// commands in S_IDLE
+			if (i2c_cmd_pulse_i && !seq_busy &&
+			    (curr_state == S_IDLE ? ctrl_pend_vld : !ctrl_pend_vld)) begin
+				ctrl_pend <= i2c_ctrl_reg_i;
+				ctrl_pend_vld <= 1;
+			end
+
+			if (i2c_abort_pulse_i) begin
+				ctrl_pend_vld <= 0;
+			end
+		end
+	end
+
+	// Overflow, set by a dropped software command and cleared by reading the
+	// status register or by an IRQ ack. Setting has priority.
+	always @(posedge clk) begin
+		if (rst) begin
+			ctrl_ovf <= 0;
+		end
+		else begin
+			if (i2c_cmd_pulse_i && (seq_busy || (curr_state != S_IDLE && ctrl_pend_vld))) begin
+				ctrl_ovf <= 1;
+			end
+			else if (i2c_status_rd_pulse_i || i2c_irq_ack_pulse_i) begin
+				ctrl_ovf <= 0;
+			end
+		end
+	end
+
+	// A byte (or a lone stop) has completed and the FSM goes back to idle or
+	// on to the pending one
+	wire byte_done;
+	assign byte_done = (curr_state != S_IDLE && next_state == S_IDLE) || ctrl_chain;
+
+	// Received byte as seen in the status, held while the next one shifts in
+	always @(posedge clk) begin
+		if (rst) begin
+			rx_data <= 8'h0;
+		end
+		else if (byte_done) begin
+			rx_data <= data_in;
+		end
+	end
+
+	// Sequencer for EEPROM page writes and write-cycle ACK polling
+	//
+	// Runs a whole page write, i.e. start, device address, one or two memory
+	// address bytes, the contents of the page buffer and stop, by issuing
+	// commands to the byte level FSM without software involvement. ACK polling
+	// repeatedly addresses the device (start, address, stop) until it ACKs,
+	// which is how the end of an EEPROM internal write cycle is detected. Both
+	// can be combined in one command and only the completion of the whole
+	// sequence raises an IRQ.
+	//
+	// SMBus block transfers use the low byte of the memory address as the
+	// command code. A block write sends the page buffer after a count byte, a
+	// block read takes the count from the device and fills the page buffer
+	// with the data, where software pops it from the data register. With PEC
+	// the CRC-8 (x^8 + x^2 + x + 1) over all bytes of the transfer, addresses
+	// included, is appended to a write or checked against the last byte read.
+	//
+	// Command word
+	//   [6:0]  device address
+	//   [7]    two byte memory address
+	//   [23:8] memory address, SMBus command code in [15:8]
+	//   [24]   page write (data previously pushed to the page buffer)
+	//   [25]   ACK poll (after the page write if both are set)
+	//   [26]   SMBus block write (data previously pushed to the page buffer)
+	//   [27]   SMBus block read
+	//   [28]   SMBus PEC
+	// A command with none of [24] to [27] set just empties the page buffer.
+	//
+	// Status word
+	//   [0]     busy
+	//   [1]     NACK error
+	//   [2]     ACK poll gave up
+	//   [3]     SMBus PEC mismatch
+	//   [4]     SMBus count of 0 or larger than the page buffer
+	//   [5]     command rejected, written while the sequencer or the byte
+	//           level FSM was busy or a ctrl word was pending. Cleared by
+	//           the next command that is accepted
+	//   [15:8]  page buffer fill level
+	//   [31:16] ACK poll attempts
+
+	parameter Q_IDLE = 4'h0, Q_ADDR = 4'h1, Q_MADDR_HI = 4'h2, Q_MADDR_LO = 4'h3, Q_DATA = 4'h4, Q_POLL = 4'h5, Q_STOP = 4'h6,
+	          Q_SMB_CMD = 4'h7, Q_SMB_WDATA = 4'h8, Q_SMB_RADDR = 4'h9, Q_SMB_RCNT = 4'ha, Q_SMB_RDATA = 4'hb, Q_SMB_PEC = 4'hc;
+
+	// Page size is at most 128 bytes
+	localparam PAGE_SIZE = 1 << C_PAGE_SIZE_LOG2;
+
+	reg seq_done;
+
+	reg[6:0] seq_dev;
+	reg seq_two_byte;
+	reg[15:0] seq_maddr;
+	reg seq_poll;
+	reg seq_smb;
+	reg seq_smb_rd;
+	reg seq_pec;
+	reg[7:0] seq_count;
+	reg[7:0] seq_crc;
+
+	reg[7:0] page_buf[0:PAGE_SIZE-1];
+	reg[C_PAGE_SIZE_LOG2:0] page_fill;
+	reg[C_PAGE_SIZE_LOG2:0] page_idx;
+
+	reg seq_nack_err;
+	reg seq_poll_err;
+	reg seq_pec_err;
+	reg seq_len_err;
+	reg seq_rej_err;
+	reg[15:0] seq_poll_cnt;
+
+	wire[7:0] seq_status_fill;
+	assign seq_status_fill = page_fill;
+
+	assign seq_busy = (seq_state != Q_IDLE);
+
+	assign i2c_seq_status_o = {seq_poll_cnt, seq_status_fill, 2'h0, seq_rej_err, seq_len_err, seq_pec_err, seq_poll_err, seq_nack_err, seq_busy};
+
+	assign i2c_seq_rdata_o = page_buf[page_idx[C_PAGE_SIZE_LOG2-1:0]];
+
+	// Control words for the byte level FSM
+	wire[12:0] seq_ctrl_poll;
+	wire[12:0] seq_ctrl_stop;
+	wire[12:0] seq_ctrl_rd;
+	wire[12:0] seq_ctrl_rd_last;
+	assign seq_ctrl_poll    = {5'b00111, seq_dev, 1'b0};
+	assign seq_ctrl_stop    = {5'b01000, 8'h00};
+	assign seq_ctrl_rd      = {5'b00000, 8'h00};
+	assign seq_ctrl_rd_last = {5'b10001, 8'h00};
+
+	// PEC over the byte that just went over the bus
+	function [7:0] crc8;
+		input [7:0] crc;
+		input [7:0] data;
+		integer b;
+		reg [7:0] c;
+		begin
+			c = crc ^ data;
+			for (b = 0; b < 8; b = b + 1) begin
+				c = c[7] ? {c[6:0], 1'b0} ^ 8'h07 : {c[6:0], 1'b0};
+			end
+			crc8 = c;
+		end
+	endfunction
+
+	wire[7:0] seq_crc_next;
+	assign seq_crc_next = crc8(seq_crc, ctrl_we ? ctrl_data : data_in);
+
+	always @(posedge clk) begin
+		if (rst) begin
+			seq_state <= Q_IDLE;
+			seq_ctrl <= 0;
+			seq_cmd_pulse <= 0;
+			seq_done <= 0;
+			seq_dev <= 0;
+			seq_two_byte <= 0;
+			seq_maddr <= 0;
+			seq_poll <= 0;
+			seq_smb <= 0;
+			seq_smb_rd <= 0;
+			seq_pec <= 0;
+			seq_count <= 0;
+			seq_crc <= 0;
+			page_fill <= 0;
+			page_idx <= 0;
+			seq_nack_err <= 0;
+			seq_poll_err <= 0;
+			seq_pec_err <= 0;
+			seq_len_err <= 0;
+			seq_rej_err <= 0;
+			seq_poll_cnt <= 0;
+		end
+		else begin
+			seq_cmd_pulse <= 0;
+			seq_done <= 0;
+
+			if (seq_busy && seq_smb && byte_done) begin
+				seq_crc <= seq_crc_next;
+			end
+
+			// Commands are only taken when everything is idle, say so
+			// instead of leaving software waiting for a sequence that
+			// never runs
+			if (i2c_seq_cmd_pulse_i && (seq_busy || curr_state != S_IDLE || ctrl_pend_vld)) begin
+				seq_rej_err <= 1;
+			end
+
+			case (seq_state)
+				Q_IDLE: begin
+					if (i2c_seq_data_pulse_i && page_fill != PAGE_SIZE) begin
+						page_buf[page_fill[C_PAGE_SIZE_LOG2-1:0]] <= i2c_seq_data_i;
+						page_fill <= page_fill + 1;
+					end
+					// Block read data, the buffer is empty again after the last byte
+					if (i2c_seq_rdata_pulse_i && page_idx < page_fill) begin
+						if (page_idx + 1 == page_fill) begin
+							page_idx <= 0;
+							page_fill <= 0;
+						end
+						else begin
+							page_idx <= page_idx + 1;
+						end
+					end
+					if (i2c_seq_cmd_pulse_i && curr_state == S_IDLE && !ctrl_pend_vld) begin
+						seq_dev <= i2c_seq_cmd_i[6:0];
+						seq_two_byte <= i2c_seq_cmd_i[7];
+						seq_maddr <= i2c_seq_cmd_i[23:8];
+						seq_poll <= i2c_seq_cmd_i[25];
+						seq_smb <= i2c_seq_cmd_i[26] || i2c_seq_cmd_i[27];
+						seq_smb_rd <= i2c_seq_cmd_i[27];
+						seq_pec <= i2c_seq_cmd_i[28];
+						seq_crc <= 0;
+						seq_nack_err <= 0;
+						seq_poll_err <= 0;
+						seq_pec_err <= 0;
+						seq_len_err <= 0;
+						seq_rej_err <= 0;
+						seq_poll_cnt <= 0;
+						page_idx <= 0;
+						if (i2c_seq_cmd_i[26] || i2c_seq_cmd_i[27]) begin
+							seq_ctrl <= {5'b00110, i2c_seq_cmd_i[6:0], 1'b0};
+							seq_cmd_pulse <= 1;
+							seq_state <= Q_ADDR;
+						end
+						else if (i2c_seq_cmd_i[24]) begin
+							seq_ctrl <= {4'b0110, i2c_seq_cmd_i[6:0], 1'b0};
+							seq_cmd_pulse <= 1;
+							seq_state <= Q_ADDR;
+						end
+						else if (i2c_seq_cmd_i[25]) begin
+							seq_ctrl <= {4'b0111, i2c_seq_cmd_i[6:0], 1'b0};
+							seq_cmd_pulse <= 1;
+							seq_state <= Q_POLL;
+						end
+						else begin
+							page_fill <= 0;
+						end
+					end
+				end
+				Q_ADDR: begin
+					if (byte_done) begin
+						seq_cmd_pulse <= 1;
+						if (ack_in) begin
+							seq_nack_err <= 1;
+							seq_ctrl <= seq_ctrl_stop;
+							seq_state <= Q_STOP;
+						end
+						else if (seq_smb) begin
+							seq_ctrl <= {5'b00100, seq_maddr[7:0]};
+							seq_state <= Q_SMB_CMD;
+						end
+						else if (seq_two_byte) begin
+							seq_ctrl <= {4'b0100, seq_maddr[15:8]};
+							seq_state <= Q_MADDR_HI;
+						end
+						else begin
+							seq_ctrl <= {3'b010, page_fill == 0, seq_maddr[7:0]};
+							seq_state <= Q_MADDR_LO;
+						end
+					end
+				end
+				Q_MADDR_HI: begin
+					if (byte_done) begin
+						seq_cmd_pulse <= 1;
+						if (ack_in) begin
+							seq_nack_err <= 1;
+							seq_ctrl <= seq_ctrl_stop;
+							seq_state <= Q_STOP;
+						end
+						else begin
+							seq_ctrl <= {3'b010, page_fill == 0, seq_maddr[7:0]};
+							seq_state <= Q_MADDR_LO;
+						end
+					end
+				end
+				Q_MADDR_LO, Q_DATA: begin
+					if (byte_done) begin
+						if (ack_in) begin
+							seq_nack_err <= 1;
+							// Unless the stop went out together with this byte
+							if (!ctrl_stop) begin
+								seq_ctrl <= seq_ctrl_stop;
+								seq_cmd_pulse <= 1;
+								seq_state <= Q_STOP;
+							end
+							else begin
+								seq_state <= Q_IDLE;
+								seq_done <= 1;
+								page_fill <= 0;
+							end
+						end
+						else if (page_idx != page_fill) begin
+							seq_ctrl <= {3'b010, page_idx + 1 == page_fill, page_buf[page_idx[C_PAGE_SIZE_LOG2-1:0]]};
+							seq_cmd_pulse <= 1;
+							page_idx <= page_idx + 1;
+							seq_state <= Q_DATA;
+						end
+						else if (seq_poll) begin
+							seq_ctrl <= seq_ctrl_poll;
+							seq_cmd_pulse <= 1;
+							page_fill <= 0;
+							seq_state <= Q_POLL;
+						end
+						else begin
+							seq_state <= Q_IDLE;
+							seq_done <= 1;
+							page_fill <= 0;
+						end
+					end
+				end
+				Q_POLL: begin
+					if (byte_done) begin
+						if (!ack_in) begin
+							seq_state <= Q_IDLE;
+							seq_done <= 1;
+						end
+						else if (seq_poll_cnt == 16'hffff) begin
+							seq_poll_err <= 1;
+							seq_state <= Q_IDLE;
+							seq_done <= 1;
+						end
+						else begin
+							seq_poll_cnt <= seq_poll_cnt + 1;
+							seq_ctrl <= seq_ctrl_poll;
+							seq_cmd_pulse <= 1;
+						end
+					end
+				end
+				Q_STOP: begin
+					if (byte_done) begin
+						seq_state <= Q_IDLE;
+						seq_done <= 1;
+						page_fill <= 0;
+					end
+				end
+				Q_SMB_CMD: begin
+					if (byte_done) begin
+						seq_cmd_pulse <= 1;
+						if (ack_in) begin
+							seq_nack_err <= 1;
+							seq_ctrl <= seq_ctrl_stop;
+							seq_state <= Q_STOP;
+						end
+						else if (seq_smb_rd) begin
+							// Repeated start, device address for reading
+							seq_ctrl <= {5'b00110, seq_dev, 1'b1};
+							seq_state <= Q_SMB_RADDR;
+						end
+						else begin
+							// Count byte
+							seq_ctrl <= {4'b0010, page_fill == 0 && !seq_pec, seq_status_fill};
+							seq_state <= Q_SMB_WDATA;
+						end
+					end
+				end
+				Q_SMB_WDATA: begin
+					if (byte_done) begin
+						if (ack_in) begin
+							seq_nack_err <= 1;
+							// Unless the stop went out together with this byte
+							if (!ctrl_stop) begin
+								seq_ctrl <= seq_ctrl_stop;
+								seq_cmd_pulse <= 1;
+								seq_state <= Q_STOP;
+							end
+							else begin
+								seq_state <= Q_IDLE;
+								seq_done <= 1;
+								page_fill <= 0;
+							end
+						end
+						else if (page_idx != page_fill) begin
+							seq_ctrl <= {4'b0010, page_idx + 1 == page_fill && !seq_pec, page_buf[page_idx[C_PAGE_SIZE_LOG2-1:0]]};
+							seq_cmd_pulse <= 1;
+							page_idx <= page_idx + 1;
+						end
+						else if (seq_pec) begin
+							seq_ctrl <= {5'b00101, seq_crc_next};
+							seq_cmd_pulse <= 1;
+							seq_state <= Q_SMB_PEC;
+						end
+						else begin
+							seq_state <= Q_IDLE;
+							seq_done <= 1;
+							page_fill <= 0;
+						end
+					end
+				end
+				Q_SMB_RADDR: begin
+					if (byte_done) begin
+						seq_cmd_pulse <= 1;
+						if (ack_in) begin
+							seq_nack_err <= 1;
+							seq_ctrl <= seq_ctrl_stop;
+							seq_state <= Q_STOP;
+						end
+						else begin
+							seq_ctrl <= seq_ctrl_rd;
+							seq_state <= Q_SMB_RCNT;
+						end
+					end
+				end
+				Q_SMB_RCNT: begin
+					if (byte_done) begin
+						seq_cmd_pulse <= 1;
+						seq_count <= data_in;
+						page_fill <= 0;
+						page_idx <= 0;
+						if (data_in == 0 || data_in > PAGE_SIZE) begin
+							// Does not fit the page buffer, one more byte to NACK and stop
+							seq_len_err <= 1;
+							seq_ctrl <= seq_ctrl_rd_last;
+							seq_state <= Q_STOP;
+						end
+						else begin
+							seq_ctrl <= data_in == 1 && !seq_pec ? seq_ctrl_rd_last : seq_ctrl_rd;
+							seq_state <= Q_SMB_RDATA;
+						end
+					end
+				end
+				Q_SMB_RDATA: begin
+					if (byte_done) begin
+						page_buf[page_fill[C_PAGE_SIZE_LOG2-1:0]] <= data_in;
+						page_fill <= page_fill + 1;
+						if (page_fill + 1 == seq_count) begin
+							if (seq_pec) begin
+								seq_ctrl <= seq_ctrl_rd_last;
+								seq_cmd_pulse <= 1;
+								seq_state <= Q_SMB_PEC;
+							end
+							else begin
+								seq_state <= Q_IDLE;
+								seq_done <= 1;
+							end
+						end
+						else begin
+							seq_ctrl <= page_fill + 2 == seq_count && !seq_pec ? seq_ctrl_rd_last : seq_ctrl_rd;
+							seq_cmd_pulse <= 1;
+						end
+					end
+				end
+				Q_SMB_PEC: begin
+					if (byte_done) begin
+						if (seq_smb_rd) begin
+							seq_pec_err <= data_in != seq_crc;
+						end
+						else begin
+							seq_nack_err <= ack_in;
+							page_fill <= 0;
+						end
+						seq_state <= Q_IDLE;
+						seq_done <= 1;
+					end
+				end
+			endcase
+
+			// Abandoned along with the byte level FSM, without raising the
+			// sequence IRQ, the end of the bus recovery does
+			if (i2c_abort_pulse_i) begin
+				seq_state <= Q_IDLE;
+				seq_done <= 0;
+				seq_cmd_pulse <= 0;
+				page_fill <= 0;
+				page_idx <= 0;
+			end
+		end
+	end
+
 	// IRQ generation
+	//
+	// Every byte raises an IRQ when driven by software, a sequence only when
+	// the whole of it has completed
+	wire irq_set;
+	assign irq_set = seq_done || (!seq_busy && byte_done);
+
 	assign i2c_irq_o = i2c_irq;
 	always @(posedge clk) begin
 		if (rst) begin
 			i2c_irq <= 0;
 		end
 		else begin
-			if (scl_4x_clk_en && curr_state != S_IDLE && next_state == S_IDLE) begin
+			if (irq_set) begin
 				i2c_irq <= 1;
 			end
 			// Clearing has lower priority
@@ -152,9 +777,76 @@ module i2c_controller #
 		end
 	end
 
-	assign status_busy = (curr_state != S_IDLE);
+	// Performance counters
+	//
+	// Free running 32-bit counters that are copied to a snapshot on request,
+	// software reads the snapshot so that all values refer to the same point
+	// in time. Control bit 0 takes a snapshot, bit 1 clears the counters (the
+	// snapshot still gets the values from before clearing when both are set).
+	//
+	//   0  bytes sent
+	//   1  bytes received
+	//   2  NACKs received
+	//   3  cycles in S_IDLE
+	//   4  cycles in S_SYNC
+	//   5  cycles in S_START
+	//   6  cycles in S_DATA
+	//   7  cycles in S_ACK
+	//   8  cycles in S_STOP
+	//   9  cycles busy
+	//   10 cycles idle, i.e. waiting for software between commands
+	//   11 IRQs raised
+	//   12 byte commands started
+
+	localparam PERF_NUM = 13;
+
+	reg[31:0] perf_cnt[0:15];
+	reg[31:0] perf_snap[0:15];
+	wire[15:0] perf_inc;
+
+	assign perf_inc[0]  = curr_state == S_DATA && next_state == S_ACK && ctrl_we;
+	assign perf_inc[1]  = curr_state == S_DATA && next_state == S_ACK && !ctrl_we;
+	assign perf_inc[2]  = curr_state == S_ACK && next_state != S_ACK && ctrl_we && ack_in;
+	assign perf_inc[3]  = curr_state == S_IDLE;
+	assign perf_inc[4]  = curr_state == S_SYNC;
+	assign perf_inc[5]  = curr_state == S_START;
+	assign perf_inc[6]  = curr_state == S_DATA;
+	assign perf_inc[7]  = curr_state == S_ACK;
+	assign perf_inc[8]  = curr_state == S_STOP;
+	assign perf_inc[9]  = status_busy;
+	assign perf_inc[10] = !status_busy;
+	assign perf_inc[11] = irq_set && !i2c_irq;
+	assign perf_inc[12] = (curr_state == S_IDLE && (cmd_pulse || ctrl_pend_vld)) || ctrl_chain;
+	assign perf_inc[15:PERF_NUM] = 0;
+
+	integer k;
+	always @(posedge clk) begin
+		if (rst) begin
+			for (k = 0; k < 16; k = k + 1) begin
+				perf_cnt[k] <= 0;
+				perf_snap[k] <= 0;
+			end
+		end
+		else begin
+			for (k = 0; k < 16; k = k + 1) begin
+				if (i2c_perf_ctrl_pulse_i && i2c_perf_ctrl_i[0]) begin
+					perf_snap[k] <= perf_cnt[k];
+				end
+				if (i2c_perf_ctrl_pulse_i && i2c_perf_ctrl_i[1]) begin
+					perf_cnt[k] <= 0;
+				end
+				else if (perf_inc[k]) begin
+					perf_cnt[k] <= perf_cnt[k] + 1;
+				end
+			end
+		end
+	end
+
+	assign i2c_perf_data_o = perf_snap[i2c_perf_sel_i];
+
+	assign status_busy = (curr_state != S_IDLE) || seq_busy || ctrl_pend_vld;
 	assign status_ack = ~ack_in;
-	assign status_data = data_in;
+	assign status_data = rx_data;
 
 	// I2C clocking scheme
 	//
@@ -206,8 +898,10 @@ module i2c_controller #
 				end
 			end
 			if (curr_state == S_ACK) begin
+				// Only driven when reading, NACK tells the slave that this
+				// was the last byte
 				if (scl_phase == 2'b00) begin
-					sda <= 1'b0;
+					sda <= ctrl_nack;
 				end
 			end
 			if (curr_state == S_DATA) begin
@@ -228,6 +922,9 @@ module i2c_controller #
 			if (curr_state == S_SYNC) begin
 				data_out <= ctrl_data;
 			end
+			if (ctrl_chain) begin
+				data_out <= ctrl_pend[7:0];
+			end
 			if (curr_state == S_DATA) begin
 				if (scl_phase == 2'b00) begin
 					data_out <= {data_out[6:0], 1'b0};
@@ -244,7 +941,7 @@ module i2c_controller #
 		else if (scl_4x_clk_en) begin
 			if (curr_state == S_DATA) begin
 				if (scl_phase == 2'b10) begin
-					data_in <= {data_in[6:0], I2C_SDA_I};
+					data_in <= {data_in[6:0], sda_in};
 				end
 			end
 		end
@@ -258,7 +955,7 @@ module i2c_controller #
 		else if (scl_4x_clk_en) begin
 			if (curr_state == S_ACK) begin
 				if (scl_phase == 2'b10) begin
-					ack_in <= I2C_SDA_I;
+					ack_in <= sda_in;
 				end
 			end
 		end
@@ -266,6 +963,7 @@ module i2c_controller #
 
 	assign I2C_SCL = curr_state == S_START ||
 	                 curr_state == S_STOP ||
+	                 curr_state == S_RECOVER ||
 	                 curr_state == S_DATA ||
 	                 curr_state == S_ACK ? scl : 1'b1;
 
@@ -0,0 +1,301 @@
+#include <errno.h>
+#include "i2c_mem.h"
+
+/* Each channel has its own register bank, channel n is at offset n * stride */
+const uint32_t i2c_chan_stride = 0x00000100;
+
+const uint32_t i2c_ctrl_addr = 0x0000100c;
+const uint32_t i2c_status_addr = 0x00001010;
+/* Status again, but the read only completes once the channel is idle (or after the wait timeout) */
+const uint32_t i2c_wait_idle_addr = 0x00001014;
+const uint32_t i2c_wait_timeout_addr = 0x00001018;
+/* Any write drops the transfer in progress and recovers the bus */
+const uint32_t i2c_abort_addr = 0x0000101c;
+
+const uint32_t i2c_seq_cmd_addr = 0x00001024;
+const uint32_t i2c_seq_data_addr = 0x00001028;
+const uint32_t i2c_seq_status_addr = 0x0000102c;
+const uint32_t i2c_perf_ctrl_addr = 0x00001030;
+const uint32_t i2c_perf_cnt_addr = 0x00001080;
+const uint32_t i2c_irq_ack_addr = 0x00001020;
+
+const uint32_t i2c_irq_cause_addr = 0x00001f00;
+const uint32_t i2c_num_chan_addr = 0x00001f04;
+
+const uint32_t i2c_ctrl_nack_bit = 1 << 12;
+const uint32_t i2c_ctrl_stop_only_bit = 1 << 11;
+const uint32_t i2c_ctrl_we_bit = 1 << 10;
+const uint32_t i2c_ctrl_start_bit = 1 << 9;
+const uint32_t i2c_ctrl_stop_bit = 1 << 8;
+
+const uint32_t i2c_status_busy_bit = 1 << 9;
+const uint32_t i2c_status_ack_bit = 1 << 8;
+const uint32_t i2c_status_timeout_bit = 1u << 31;
+/* The next ctrl word is queued behind the byte in progress */
+const uint32_t i2c_status_pending_bit = 1 << 10;
+/* A ctrl write was dropped, cleared by reading the status register or an irq ack */
+const uint32_t i2c_status_overflow_bit = 1 << 11;
+/* The last abort gave up, SCL held low */
+const uint32_t i2c_status_stuck_bit = 1 << 12;
+
+const uint32_t i2c_seq_cmd_poll_bit = 1 << 25;
+const uint32_t i2c_seq_cmd_page_write_bit = 1 << 24;
+const uint32_t i2c_seq_cmd_two_byte_bit = 1 << 7;
+const uint32_t i2c_seq_cmd_smb_write_bit = 1 << 26;
+const uint32_t i2c_seq_cmd_smb_read_bit = 1 << 27;
+const uint32_t i2c_seq_cmd_smb_pec_bit = 1 << 28;
+
+const uint32_t i2c_seq_status_busy_bit = 1 << 0;
+const uint32_t i2c_seq_status_poll_err_bit = 1 << 2;
+const uint32_t i2c_seq_status_nack_err_bit = 1 << 1;
+const uint32_t i2c_seq_status_pec_err_bit = 1 << 3;
+const uint32_t i2c_seq_status_len_err_bit = 1 << 4;
+/* Command written while the controller was busy, it did not run */
+const uint32_t i2c_seq_status_rej_err_bit = 1 << 5;
+
+const uint32_t i2c_perf_ctrl_clear_bit = 1 << 1;
+const uint32_t i2c_perf_ctrl_snapshot_bit = 1 << 0;
+
+/* End a transfer left open by a missing ACK, the abort recovers the bus and sends the stop */
+static int i2c_mem_fail(int chan, int err)
+{
+	axi_master_write(i2c_abort_addr + chan * i2c_chan_stride, 1);
+
+	return err;
+}
+
+int i2c_mem_write(int chan, uint8_t i2c_addr, uint8_t mem_addr, uint8_t mem_data)
+{
+	const uint32_t ctrl_addr = i2c_ctrl_addr + chan * i2c_chan_stride;
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	uint32_t status;
+	/* Make sure interface is not busy */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+
+	/* Address for write mode */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 0 << 0);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -ENXIO);
+
+	/* Memory address */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -EIO);
+
+	/* Memory data */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_stop_bit | mem_data);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -EIO);
+
+	return 0;
+}
+
+int i2c_mem_read(int chan, uint8_t i2c_addr, uint8_t mem_addr)
+{
+	const uint32_t ctrl_addr = i2c_ctrl_addr + chan * i2c_chan_stride;
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	uint32_t status;
+	/* Make sure interface is not busy */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+
+	/* Address for write mode */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 0 << 0);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -ENXIO);
+
+	/* Memory address */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -EIO);
+
+	/* Address for read mode */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 1 << 0);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -ENXIO);
+
+	/* Memory data */
+	axi_master_write(ctrl_addr, i2c_ctrl_stop_bit);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -EIO);
+
+	return status & 0xff;
+}
+
+int i2c_mem_write_page(int chan, uint8_t i2c_addr, uint16_t mem_addr, int two_byte, const uint8_t *mem_data, int len)
+{
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	uint32_t status;
+	/* Make sure interface is not busy */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+
+	/* Fill page buffer */
+	for (int i = 0; i < len; i++) {
+		axi_master_write(i2c_seq_data_addr + chan * i2c_chan_stride, mem_data[i]);
+	}
+
+	/* Page write followed by ACK polling until the write cycle is over */
+	axi_master_write(i2c_seq_cmd_addr + chan * i2c_chan_stride,
+	                 i2c_seq_cmd_poll_bit | i2c_seq_cmd_page_write_bit | mem_addr << 8 |
+	                 (two_byte ? i2c_seq_cmd_two_byte_bit : 0) | i2c_addr);
+
+	/* Wait until complete */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+	status = axi_master_read(i2c_seq_status_addr + chan * i2c_chan_stride);
+	if (status & i2c_seq_status_rej_err_bit)
+		return -EBUSY;
+	if (status & i2c_seq_status_nack_err_bit)
+		return -EIO;
+	if (status & i2c_seq_status_poll_err_bit)
+		return -ETIMEDOUT;
+
+	return 0;
+}
+
+/* Address the device once and then stream bytes, the memory auto increments */
+int i2c_mem_read_seq(int chan, uint8_t i2c_addr, uint16_t mem_addr, int two_byte, uint8_t *mem_data, int len)
+{
+	const uint32_t ctrl_addr = i2c_ctrl_addr + chan * i2c_chan_stride;
+	const uint32_t status_addr = i2c_status_addr + chan * i2c_chan_stride;
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	uint32_t status;
+	/* Make sure interface is not busy */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+
+	/* Address for write mode */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 0 << 0);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -ENXIO);
+
+	if (two_byte) {
+		/* Memory address high byte */
+		axi_master_write(ctrl_addr, i2c_ctrl_we_bit | mem_addr >> 8);
+
+		/* Wait until complete */
+		while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+		if (!(status & i2c_status_ack_bit))
+			return i2c_mem_fail(chan, -EIO);
+	}
+
+	/* Memory address */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | (mem_addr & 0xff));
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -EIO);
+
+	/* Address for read mode */
+	axi_master_write(ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 1 << 0);
+
+	/* Wait until complete */
+	while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+	if (!(status & i2c_status_ack_bit))
+		return i2c_mem_fail(chan, -ENXIO);
+
+	/* Memory data, NACK and stop after the last byte */
+	axi_master_write(ctrl_addr, len == 1 ? i2c_ctrl_nack_bit | i2c_ctrl_stop_bit : 0);
+
+	for (int i = 0; i < len; i++) {
+		if (i + 1 < len) {
+			/* Queue the next byte while this one shifts, no gap on the bus */
+			axi_master_write(ctrl_addr, i + 2 == len ? i2c_ctrl_nack_bit | i2c_ctrl_stop_bit : 0);
+
+			/* This one is complete once the queued one has started */
+			while ((status = axi_master_read(status_addr)) & i2c_status_pending_bit);
+		}
+		else {
+			/* Wait until complete */
+			while ((status = axi_master_read(wait_addr)) & i2c_status_busy_bit);
+		}
+		mem_data[i] = status & 0xff;
+	}
+
+	return 0;
+}
+
+/* SMBus block write of 1 to 32 bytes, the controller sends the count byte and the PEC */
+int i2c_smbus_block_write(int chan, uint8_t i2c_addr, uint8_t cmd, int pec, const uint8_t *data, int len)
+{
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	uint32_t status;
+	/* Make sure interface is not busy */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+
+	/* Fill page buffer */
+	for (int i = 0; i < len; i++) {
+		axi_master_write(i2c_seq_data_addr + chan * i2c_chan_stride, data[i]);
+	}
+
+	axi_master_write(i2c_seq_cmd_addr + chan * i2c_chan_stride,
+	                 i2c_seq_cmd_smb_write_bit | (pec ? i2c_seq_cmd_smb_pec_bit : 0) | cmd << 8 | i2c_addr);
+
+	/* Wait until complete */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+	status = axi_master_read(i2c_seq_status_addr + chan * i2c_chan_stride);
+	if (status & i2c_seq_status_rej_err_bit)
+		return -EBUSY;
+	if (status & i2c_seq_status_nack_err_bit)
+		return -EIO;
+
+	return 0;
+}
+
+/*
+ * SMBus block read into data (room for 32 bytes), the device's count byte
+ * sets the length. Returns the count, -EMSGSIZE for a count that does not
+ * fit the page buffer or -EBADMSG for a PEC mismatch.
+ */
+int i2c_smbus_block_read(int chan, uint8_t i2c_addr, uint8_t cmd, int pec, uint8_t *data)
+{
+	const uint32_t wait_addr = i2c_wait_idle_addr + chan * i2c_chan_stride;
+	uint32_t status;
+	int len;
+	/* Make sure interface is not busy */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+
+	axi_master_write(i2c_seq_cmd_addr + chan * i2c_chan_stride,
+	                 i2c_seq_cmd_smb_read_bit | (pec ? i2c_seq_cmd_smb_pec_bit : 0) | cmd << 8 | i2c_addr);
+
+	/* Wait until complete */
+	while (axi_master_read(wait_addr) & i2c_status_busy_bit);
+	status = axi_master_read(i2c_seq_status_addr + chan * i2c_chan_stride);
+	if (status & i2c_seq_status_rej_err_bit)
+		return -EBUSY;
+	if (status & i2c_seq_status_nack_err_bit)
+		return -EIO;
+	if (status & i2c_seq_status_len_err_bit) {
+		return -EMSGSIZE;
+	}
+
+	/* Pop the data from the page buffer, the fill level is the count */
+	len = (status >> 8) & 0xff;
+	for (int i = 0; i < len; i++) {
+		data[i] = axi_master_read(i2c_seq_data_addr + chan * i2c_chan_stride);
+	}
+
+	return status & i2c_seq_status_pec_err_bit ? -EBADMSG : len;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Register level access to the I2C controller, shared by the test client and
+ * the userspace (UIO) library. Addresses are AXI addresses, the application
+ * provides the backend carrying out the accesses.
+ */
+
+void axi_master_write(uint32_t address, uint32_t data);
+uint32_t axi_master_read(uint32_t address);
+
+/* Each channel has its own register bank, channel n is at offset n * stride */
+extern const uint32_t i2c_chan_stride;
+
+extern const uint32_t i2c_ctrl_addr;
+extern const uint32_t i2c_status_addr;
+extern const uint32_t i2c_wait_idle_addr;
+extern const uint32_t i2c_wait_timeout_addr;
+extern const uint32_t i2c_abort_addr;
+
+extern const uint32_t i2c_seq_cmd_addr;
+extern const uint32_t i2c_seq_data_addr;
+extern const uint32_t i2c_seq_status_addr;
+extern const uint32_t i2c_perf_ctrl_addr;
+extern const uint32_t i2c_perf_cnt_addr;
+extern const uint32_t i2c_irq_ack_addr;
+
+extern const uint32_t i2c_irq_cause_addr;
+extern const uint32_t i2c_num_chan_addr;
+
+extern const uint32_t i2c_ctrl_nack_bit;
+extern const uint32_t i2c_ctrl_stop_only_bit;
+extern const uint32_t i2c_ctrl_we_bit;
+extern const uint32_t i2c_ctrl_start_bit;
+extern const uint32_t i2c_ctrl_stop_bit;
+
+extern const uint32_t i2c_status_busy_bit;
+extern const uint32_t i2c_status_ack_bit;
+extern const uint32_t i2c_status_timeout_bit;
+extern const uint32_t i2c_status_pending_bit;
+extern const uint32_t i2c_status_overflow_bit;
+extern const uint32_t i2c_status_stuck_bit;
+
+extern const uint32_t i2c_seq_cmd_poll_bit;
+extern const uint32_t i2c_seq_cmd_page_write_bit;
+extern const uint32_t i2c_seq_cmd_two_byte_bit;
+extern const uint32_t i2c_seq_cmd_smb_write_bit;
+extern const uint32_t i2c_seq_cmd_smb_read_bit;
+extern const uint32_t i2c_seq_cmd_smb_pec_bit;
+
+extern const uint32_t i2c_seq_status_busy_bit;
+extern const uint32_t i2c_seq_status_poll_err_bit;
+extern const uint32_t i2c_seq_status_nack_err_bit;
+extern const uint32_t i2c_seq_status_pec_err_bit;
+extern const uint32_t i2c_seq_status_len_err_bit;
+extern const uint32_t i2c_seq_status_rej_err_bit;
+
+extern const uint32_t i2c_perf_ctrl_clear_bit;
+extern const uint32_t i2c_perf_ctrl_snapshot_bit;
+
+/*
+ * Transfers return 0 (reads the byte or count) on success or a negative errno
+ * value: -ENXIO for an address NACK, -EIO for a data NACK, -EBUSY for a
+ * sequencer command rejected while busy and -ETIMEDOUT for a write cycle ACK
+ * poll that gave up.
+ */
+int i2c_mem_write(int chan, uint8_t i2c_addr, uint8_t mem_addr, uint8_t mem_data);
+int i2c_mem_read(int chan, uint8_t i2c_addr, uint8_t mem_addr);
+int i2c_mem_write_page(int chan, uint8_t i2c_addr, uint16_t mem_addr, int two_byte, const uint8_t *mem_data, int len);
+int i2c_mem_read_seq(int chan, uint8_t i2c_addr, uint16_t mem_addr, int two_byte, uint8_t *mem_data, int len);
+int i2c_smbus_block_write(int chan, uint8_t i2c_addr, uint8_t cmd, int pec, const uint8_t *data, int len);
+int i2c_smbus_block_read(int chan, uint8_t i2c_addr, uint8_t cmd, int pec, uint8_t *data);
@@ -2,6 +2,11 @@
 // https://github.com/olofk/i2c/blob/master/bench/verilog/i2c_slave_model.v
 // Modified by Markus Lavin in 2018
 //  - Made memory size consistent
+//  - Behaves like a 24Cxx EEPROM: one or two address bytes, memory sizes up
+//    to 64KiB, page write buffer with wraparound, sequential reads that roll
+//    over at the end of memory and a write cycle during which it NACKs
+//  - Optional clock stretching after each acknowledge
+//  - Optional SMBus block device mode with PEC
 /////////////////////////////////////////////////////////////////////
 ////                                                             ////
 ////  WISHBONE rev.B2 compliant synthesizable I2C Slave model    ////
@@ -76,12 +81,25 @@ module i2c_slave_model (scl, sda);
 	// parameters
 	//
 	parameter I2C_ADR = 7'b001_0000;
-	parameter MEM_SIZE = 16;
+	parameter MEM_SIZE = 16;    // bytes, at most 65536
+	parameter ADR_BYTES = 1;    // number of memory address bytes, 1 or 2
+	parameter PAGE_SIZE = 16;   // page write buffer size, power of two
+	parameter T_WR = 0;         // write cycle time, 0 for instant writes
+	parameter T_STRETCH = 0;    // SCL low time added after acknowledge, 0 for none
+	parameter SMBUS = 0;        // SMBus block device instead of an EEPROM, see below
+
+	// In SMBus mode the address byte is the command code, selecting one of
+	// MEM_SIZE/32 blocks of up to 32 bytes (command codes wrap around). A
+	// block write sends the count byte, the data and optionally a PEC byte,
+	// which is NACKed and the write discarded when wrong. A block read after
+	// a repeated start returns the count byte, the data and the PEC byte.
+	// Unwritten blocks have a count of 0. Needs ADR_BYTES 1, PAGE_SIZE 32.
+	localparam SMB_BLOCKS = MEM_SIZE >= 32 ? MEM_SIZE / 32 : 1;
 
 	//
 	// input && outpus
 	//
-	input scl;
+	inout scl;
 	inout sda;
 
 	//
@@ -90,8 +108,37 @@ module i2c_slave_model (scl, sda);
 	wire debug = 1'b1;
 
 	reg [7:0] mem [MEM_SIZE-1:0]; // initiate memory
-	reg [7:0] mem_adr;   // memory address
+	reg [15:0] mem_adr;  // memory address
 	reg [7:0] mem_do;    // memory data output
+	reg       adr_hi;    // high address byte received, low byte next
+
+	reg [7:0] page_buf [PAGE_SIZE-1:0]; // page write buffer
+	reg       page_vld [PAGE_SIZE-1:0];
+	reg [15:0] page_adr; // page being written
+	reg       wr_pend;   // page buffer holds data to commit on stop
+	reg       wr_busy;   // internal write cycle in progress
+	integer   i;
+
+	reg [7:0] smb_cmd;      // SMBus command code
+	reg [5:0] smb_len [SMB_BLOCKS-1:0]; // block byte counts
+	reg [7:0] smb_idx;      // byte within the block transfer, 0 is the count
+	reg [7:0] smb_cnt;      // count byte of a block write
+	reg [7:0] smb_crc;      // PEC over the transaction so far
+	reg [7:0] smb_crc_nxt;  // including the current byte
+	reg       smb_pec_bad;  // block write with a wrong PEC, discarded
+
+	wire [7:0] smb_blk = smb_cmd % SMB_BLOCKS;
+	wire [15:0] smb_base = smb_blk * 32;
+
+	// CRC-8, polynomial x^8 + x^2 + x + 1
+	function [7:0] crc8(input [7:0] crc, input [7:0] d);
+	  integer k;
+	  begin
+	      crc8 = crc ^ d;
+	      for (k = 0; k < 8; k = k + 1)
+	        crc8 = crc8[7] ? {crc8[6:0], 1'b0} ^ 8'h07 : {crc8[6:0], 1'b0};
+	  end
+	endfunction
 
 	reg sta, d_sta;
 	reg sto, d_sto;
@@ -106,6 +153,7 @@ module i2c_slave_model (scl, sda);
 	reg       ld;        // load downcounter
 
 	reg       sda_o;     // sda-drive level
+	reg       scl_o;     // scl-drive level, low while stretching the clock
 	wire      sda_dly;   // delayed version of sda
 
 	// statemachine declaration
@@ -125,7 +173,20 @@ module i2c_slave_model (scl, sda);
 	initial
 	begin
 	   sda_o = 1'b1;
+	   scl_o = 1'b1;
 	   state = idle;
+	   adr_hi = 1'b0;
+	   mem_adr = 16'h0;
+	   wr_pend = 1'b0;
+	   wr_busy = 1'b0;
+	   smb_crc = 8'h00;
+	   smb_pec_bad = 1'b0;
+	   for (i = 0; i < SMB_BLOCKS; i = i + 1)
+	     smb_len[i] = 6'd0;
+	   for (i = 0; i < MEM_SIZE; i = i + 1)
+	     mem[i] = 8'hff; // erased
+	   for (i = 0; i < PAGE_SIZE; i = i + 1)
+	     page_vld[i] = 1'b0;
 	end
 
 	// generate shift register
@@ -194,6 +255,9 @@ module i2c_slave_model (scl, sda);
 	  if (sto || (sta && !d_sta) )
 	    begin
 	        state <= #1 idle; // reset statemachine
+	        adr_hi <= #1 1'b0;
+	        if (sto)
+	          smb_crc <= #1 8'h00; // PEC spans repeated starts
 
 	        sda_o <= #1 1'b1;
 	        ld    <= #1 1'b1;
@@ -206,11 +270,13 @@ module i2c_slave_model (scl, sda);
 
 	        case(state) // synopsys full_case parallel_case
 	            idle: // idle state
-	              if (acc_done && my_adr)
+	              if (acc_done && my_adr && !wr_busy) // no ACK during write cycle
 	                begin
 	                    state <= #1 slave_ack;
 	                    rw <= #1 sr[0];
 	                    sda_o <= #1 1'b0; // generate i2c_ack
+	                    if (SMBUS)
+	                      smb_crc <= #1 crc8(smb_crc, sr);
 
 	                    #2;
 	                    if(debug && rw)
@@ -218,7 +284,13 @@ module i2c_slave_model (scl, sda);
 	                    if(debug && !rw)
 	                      $display("DEBUG i2c_slave; command byte received (write) at %t", $time);
 
-	                    if(rw)
+	                    if(rw && SMBUS)
+	                      begin
+	                          // block read starts with the count byte
+	                          mem_do <= #1 {2'b00, smb_len[smb_blk]};
+	                          smb_idx <= #1 8'd1;
+	                      end
+	                    else if(rw)
 	                      begin
 	                          mem_do <= #1 mem[mem_adr];
 
@@ -247,8 +319,33 @@ module i2c_slave_model (scl, sda);
 	              if(acc_done)
 	                begin
 	                    state <= #1 gma_ack;
-	                    mem_adr <= #1 sr; // store memory address
-	                    sda_o <= #1 !(sr < MEM_SIZE); // generate i2c_ack, for valid address
+	                    if (ADR_BYTES == 2 && !adr_hi)
+	                      begin
+	                          adr_hi <= #1 1'b1;
+	                          mem_adr[15:8] <= #1 sr; // store high address byte
+	                          sda_o <= #1 1'b0;
+	                      end
+	                    else if (SMBUS)
+	                      begin
+	                          smb_cmd <= #1 sr; // command code, any is accepted
+	                          smb_idx <= #1 8'd0;
+	                          smb_crc <= #1 crc8(smb_crc, sr);
+	                          sda_o <= #1 1'b0;
+	                      end
+	                    else
+	                      begin
+	                          adr_hi <= #1 1'b0;
+	                          if (ADR_BYTES == 2)
+	                            begin
+	                                mem_adr[7:0] <= #1 sr; // store low address byte
+	                                sda_o <= #1 !({mem_adr[15:8], sr} < MEM_SIZE); // generate i2c_ack, for valid address
+	                            end
+	                          else
+	                            begin
+	                                mem_adr <= #1 {8'h00, sr}; // store memory address
+	                                sda_o <= #1 !(sr < MEM_SIZE); // generate i2c_ack, for valid address
+	                            end
+	                      end
 
 	                    if(debug)
 	                      #1 $display("DEBUG i2c_slave; address received. adr=%x, ack=%b", sr, sda_o);
@@ -256,7 +353,7 @@ module i2c_slave_model (scl, sda);
 
 	            gma_ack:
 	              begin
-	                  state <= #1 data;
+	                  state <= #1 adr_hi ? get_mem_adr : data;
 	                  ld    <= #1 1'b1;
 	              end
 
@@ -268,20 +365,75 @@ module i2c_slave_model (scl, sda);
 	                  if(acc_done)
 	                    begin
 	                        state <= #1 data_ack;
-	                        mem_adr <= #2 mem_adr + 8'h1;
 	                        sda_o <= #1 (rw && (mem_adr < MEM_SIZE) ); // send ack on write, receive ack on read
 
-	                        if(rw)
+	                        if(SMBUS)
+	                          begin
+	                              smb_crc_nxt = crc8(smb_crc, sr);
+	                              smb_crc <= #1 smb_crc_nxt;
+	                              smb_idx <= #1 smb_idx + 8'd1;
+	                          end
+
+	                        if(rw && SMBUS)
+	                          begin
+	                              // data bytes, then the PEC over everything sent so far
+	                              if (smb_idx <= smb_len[smb_blk])
+	                                mem_do <= #3 mem[smb_base + smb_idx - 1];
+	                              else if (smb_idx == smb_len[smb_blk] + 1)
+	                                mem_do <= #3 smb_crc_nxt;
+	                              else
+	                                mem_do <= #3 8'hff;
+	                              sda_o <= #1 1'b1;
+	                          end
+
+	                        if(!rw && SMBUS)
 	                          begin
+	                              if (smb_idx == 0)
+	                                begin
+	                                    // count byte, NACKed unless 1 to 32
+	                                    smb_cnt <= #1 sr;
+	                                    sda_o <= #1 (sr == 0 || sr > 32);
+	                                end
+	                              else if (smb_idx <= smb_cnt && smb_cnt <= 32)
+	                                begin
+	                                    page_buf[smb_idx - 1] <= #1 sr;
+	                                    page_vld[smb_idx - 1] <= #1 1'b1;
+	                                    page_adr <= #1 smb_base;
+	                                    wr_pend <= #1 1'b1;
+	                                end
+	                              else if (smb_idx == smb_cnt + 1 && sr != smb_crc)
+	                                begin
+	                                    sda_o <= #1 1'b1;
+	                                    smb_pec_bad <= #1 1'b1;
+
+	                                    if(debug)
+	                                      $display("DEBUG i2c_slave; PEC %x, expected %x", sr, smb_crc);
+	                                end
+	                              else if (smb_idx > smb_cnt + 1)
+	                                sda_o <= #1 1'b1;
+	                          end
+
+	                        if(rw && !SMBUS)
+	                          begin
+	                              // sequential read, rolls over at the end of memory
+	                              mem_adr <= #2 (mem_adr + 16'h1) % MEM_SIZE;
+
 	                              #3 mem_do <= mem[mem_adr];
 
 	                              if(debug)
 	                                #5 $display("DEBUG i2c_slave; data block read %x from address %x (2)", mem_do, mem_adr);
 	                          end
 
-	                        if(!rw)
+	                        if(!rw && !SMBUS)
 	                          begin
-	                              mem[ mem_adr[3:0] ] <= #1 sr; // store data in memory
+	                              // store data in page buffer, committed to memory on stop
+	                              page_buf[mem_adr % PAGE_SIZE] <= #1 sr;
+	                              page_vld[mem_adr % PAGE_SIZE] <= #1 1'b1;
+	                              page_adr <= #1 mem_adr - (mem_adr % PAGE_SIZE);
+	                              wr_pend <= #1 1'b1;
+
+	                              // address rolls over within the page
+	                              mem_adr <= #2 (mem_adr - (mem_adr % PAGE_SIZE)) | ((mem_adr + 16'h1) % PAGE_SIZE);
 
 	                              if(debug)
 	                                #2 $display("DEBUG i2c_slave; data block write %x to address %x", sr, mem_adr);
@@ -314,13 +466,60 @@ module i2c_slave_model (scl, sda);
 	        endcase
 	    end
 
+	// page write buffer is discarded by a (repeated) start
+	always @(posedge sta)
+	  if (!wr_busy)
+	    begin
+	        wr_pend <= #1 1'b0;
+	        smb_pec_bad <= #1 1'b0;
+	        for (i = 0; i < PAGE_SIZE; i = i + 1)
+	          page_vld[i] <= #1 1'b0;
+	    end
+
+	// stop commits the page write buffer and starts the write cycle
+	always @(posedge sto)
+	  if (wr_pend)
+	    begin
+	        if (!smb_pec_bad)
+	          for (i = 0; i < PAGE_SIZE; i = i + 1)
+	            if (page_vld[i])
+	              mem[page_adr + i] = page_buf[i];
+	        if (SMBUS && !smb_pec_bad)
+	          smb_len[smb_blk] = smb_cnt;
+	        for (i = 0; i < PAGE_SIZE; i = i + 1)
+	          page_vld[i] = 1'b0;
+	        wr_pend = 1'b0;
+
+	        if(debug)
+	          $display("DEBUG i2c_slave; page %x committed at %t", page_adr, $time);
+
+	        if (T_WR > 0)
+	          begin
+	              wr_busy = 1'b1;
+	              #T_WR wr_busy = 1'b0;
+
+	              if(debug)
+	                $display("DEBUG i2c_slave; write cycle done at %t", $time);
+	          end
+	    end
+
 	// read data from memory
 	always @(posedge scl)
 	  if(!acc_done && rw)
 	    mem_do <= #1 {mem_do[6:0], 1'b1}; // insert 1'b1 for host ack generation
 
+	// stretch the clock after the acknowledge, i.e. hold scl low after the
+	// falling edge that ends the acknowledge bit
+	always @(negedge scl)
+	  if (T_STRETCH > 0 && (state == slave_ack || state == gma_ack || state == data_ack))
+	    begin
+	        scl_o = 1'b0;
+	        #T_STRETCH scl_o = 1'b1;
+	    end
+
 	// generate tri-states
 	assign sda = sda_o ? 1'bz : 1'b0;
+	assign scl = scl_o ? 1'bz : 1'b0;
 
 
 	//
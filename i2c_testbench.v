@@ -1,6 +1,14 @@
 module tb #(
   parameter integer C_AXI_DATA_WIDTH = 32,
-  parameter integer C_AXI_ADDR_WIDTH = 13
+  parameter integer C_AXI_ADDR_WIDTH = 13,
+  parameter integer C_NUM_CHANNELS = 2,
+
+  // Bus topology, see the slave models below (at most 8 slaves)
+  parameter integer C_NUM_SLAVES = 6,
+  parameter [8*4-1:0] C_SLAVE_CHAN = {4'd0, 4'd1, 4'd1, 4'd0, 4'd0, 4'd0},
+  parameter [8*7-1:0] C_SLAVE_ADDR = {7'h58, 7'h54, 7'h10, 7'h51, 7'h50, 7'h10},
+  parameter [8*2-1:0] C_SLAVE_TYPE = {2'd3, 2'd2, 2'd2, 2'd1, 2'd1, 2'd0},
+  parameter [8*16-1:0] C_SLAVE_STRETCH = {16'd0, 16'd200, 16'd0, 16'd100, 16'd0, 16'd0}
 );
 
 	reg clk, rst;
@@ -31,13 +39,28 @@ module tb #(
 	wire busy_bit;
 	wire i2c_irq;
 
-	wire i2c_scl;
-	wire i2c_sda_io;
+	wire [C_NUM_CHANNELS-1 : 0] i2c_irq_vec;
+
+	wire [C_NUM_CHANNELS-1 : 0] i2c_scl;
+	wire [C_NUM_CHANNELS-1 : 0] i2c_sda_io;
+
+	wire i2c_nack;
+	wire [C_NUM_CHANNELS-1 : 0] i2c_nack_vec;
+
+	// Waveform dumping, driven by the VPI module
+	reg dump_on;
+	reg [7:0] dump_scope;
+	reg [7:0] dump_depth;
+	reg dump_started;
+
+	genvar i;
 
 	assign axi_aclk = clk;
 	assign axi_aresetn = ~rst;
 
-	i2c_axi_top dut(
+	i2c_axi_top #(
+	  .C_NUM_CHANNELS(C_NUM_CHANNELS))
+	dut(
 	  .S00_AXI_aclk(axi_aclk),
 	  .S00_AXI_aresetn(axi_aresetn),
 	  .S00_AXI_awaddr(axi_awaddr),
@@ -62,18 +85,155 @@ module tb #(
 
 	  .busy_bit_o(busy_bit),
 	  .i2c_irq_o(i2c_irq),
+	  .i2c_irq_vec_o(i2c_irq_vec),
 
-	  .I2C_SCL_O(i2c_scl),
+	  .I2C_SCL_IO(i2c_scl),
 	  .I2C_SDA_IO(i2c_sda_io)
 	);
 
-	i2c_slave_model i2c_slave(
-	  .scl(i2c_scl),
-	  .sda(i2c_sda_io)
-	);
+	// Slave models hanging on the buses
+	//
+	// Each slave model is described by one entry in the C_SLAVE_* parameters
+	// (slave n in bits [n*w +: w]): the channel whose bus it is attached to,
+	// its I2C address, its device type and how long it stretches the clock
+	// after every acknowledge (0 for no clock stretching).
+	//
+	// Device types
+	//   0  small 16 byte memory, one address byte, instant writes
+	//   1  24C02 style 256 byte EEPROM, one address byte, 8 byte pages
+	//   2  24C256 style 32KiB EEPROM, two address bytes, 64 byte pages
+	//   3  SMBus block device, 16 blocks of up to 32 bytes, PEC
+	generate
+	for (i = 0; i < C_NUM_SLAVES; i = i + 1) begin : g_slave
+		localparam integer CHAN = C_SLAVE_CHAN[i*4 +: 4];
+		localparam [6:0] ADDR = C_SLAVE_ADDR[i*7 +: 7];
+		localparam integer TYPE = C_SLAVE_TYPE[i*2 +: 2];
+		localparam integer STRETCH = C_SLAVE_STRETCH[i*16 +: 16];
+
+		// Slaves on channels that are not built are left out
+		if (CHAN >= C_NUM_CHANNELS) begin : g_none
+		end
+		else if (TYPE == 0) begin : g_small
+			i2c_slave_model #(
+			  .I2C_ADR(ADDR),
+			  .T_STRETCH(STRETCH))
+			i2c_slave(
+			  .scl(i2c_scl[CHAN]),
+			  .sda(i2c_sda_io[CHAN])
+			);
+		end
+		else if (TYPE == 1) begin : g_24c02
+			i2c_slave_model #(
+			  .I2C_ADR(ADDR),
+			  .MEM_SIZE(256),
+			  .ADR_BYTES(1),
+			  .PAGE_SIZE(8),
+			  .T_WR(5000),
+			  .T_STRETCH(STRETCH))
+			i2c_slave(
+			  .scl(i2c_scl[CHAN]),
+			  .sda(i2c_sda_io[CHAN])
+			);
+		end
+		else if (TYPE == 2) begin : g_24c256
+			i2c_slave_model #(
+			  .I2C_ADR(ADDR),
+			  .MEM_SIZE(32768),
+			  .ADR_BYTES(2),
+			  .PAGE_SIZE(64),
+			  .T_WR(5000),
+			  .T_STRETCH(STRETCH))
+			i2c_slave(
+			  .scl(i2c_scl[CHAN]),
+			  .sda(i2c_sda_io[CHAN])
+			);
+		end
+		else begin : g_smbus
+			i2c_slave_model #(
+			  .I2C_ADR(ADDR),
+			  .MEM_SIZE(512),
+			  .ADR_BYTES(1),
+			  .PAGE_SIZE(32),
+			  .SMBUS(1),
+			  .T_STRETCH(STRETCH))
+			i2c_slave(
+			  .scl(i2c_scl[CHAN]),
+			  .sda(i2c_sda_io[CHAN])
+			);
+		end
+	end
+	endgenerate
+
+	// Waveform dumping is off by default and started and stopped by the VPI
+	// module, on request from the client or on a trigger. Scope and depth are
+	// taken from the first start, later ones only resume a paused dump.
+	//
+	// Scope bits
+	//   0  testbench, with depth 1 only the AXI and I2C bus signals
+	//   1  i2c_axi_top and below
+	//   2  AXI register file
+	always @(dump_on) begin
+		if (dump_on && !dump_started) begin
+			if (dump_scope[0] || dump_scope == 0)
+				$dumpvars(dump_depth, tb);
+			if (dump_scope[1])
+				$dumpvars(dump_depth, dut);
+			if (dump_scope[2])
+				$dumpvars(dump_depth, dut.u_i2c_axi_slave);
+			dump_started = 1;
+		end
+		else if (dump_on)
+			$dumpon;
+		else if (dump_started)
+			$dumpoff;
+	end
+
+	// Bus monitors flagging a NACK of a byte sent by the master (address or
+	// write data), used as waveform trigger. The flag is held until the next
+	// SCL rising edge.
+	assign i2c_nack = |i2c_nack_vec;
+
+	generate
+	for (i = 0; i < C_NUM_CHANNELS; i = i + 1) begin : g_mon
+		reg [3:0] bit_cnt = 0;
+		reg first = 0;
+		reg rd = 0;
+		reg nack = 0;
+
+		assign i2c_nack_vec[i] = nack;
+
+		// (Repeated) start
+		always @(negedge i2c_sda_io[i]) begin
+			if (i2c_scl[i] === 1'b1) begin
+				bit_cnt <= 0;
+				first <= 1;
+			end
+		end
+
+		always @(posedge i2c_scl[i]) begin
+			nack <= 0;
+			if (bit_cnt == 8) begin
+				// Acknowledge slot, the slave acknowledges address and write data
+				if ((first || !rd) && i2c_sda_io[i] !== 1'b0)
+					nack <= 1;
+				first <= 0;
+				bit_cnt <= 0;
+			end
+			else begin
+				// R/W bit of the address byte
+				if (first && bit_cnt == 7)
+					rd <= i2c_sda_io[i];
+				bit_cnt <= bit_cnt + 1;
+			end
+		end
+	end
+	endgenerate
 
 	initial begin
-		$dumpvars;
+		dump_on = 0;
+		dump_scope = 0;
+		dump_depth = 0;
+		dump_started = 0;
 		clk = 0;
 		rst = 1;
 		lrclk = 0;
@@ -88,8 +248,8 @@ module tb #(
 	always bclk = #3 ~bclk;
 
 	// I2C bus needs pullups on both SCL and SDA for correct operation
-	assign (weak0, weak1) i2c_scl = 1'b1;
-	assign (weak0, weak1) i2c_sda_io = 1'b1;
+	assign (weak0, weak1) i2c_scl = {C_NUM_CHANNELS{1'b1}};
+	assign (weak0, weak1) i2c_sda_io = {C_NUM_CHANNELS{1'b1}};
 
 endmodule
 
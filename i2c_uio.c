@@ -0,0 +1,109 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <libgen.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "i2c_mem.h"
+#include "i2c_uio.h"
+
+/* The register window starts at this AXI address */
+static const uint32_t i2c_uio_base = 0x00001000;
+
+static int uio_fd = -1;
+static volatile uint32_t *uio_regs;
+static size_t uio_size;
+
+void axi_master_write(uint32_t address, uint32_t data)
+{
+	uio_regs[(address - i2c_uio_base) / 4] = data;
+}
+
+uint32_t axi_master_read(uint32_t address)
+{
+	return uio_regs[(address - i2c_uio_base) / 4];
+}
+
+/* Size of the register window as told by the kernel */
+static size_t i2c_uio_map_size(const char *path)
+{
+	char buf[256];
+	char sysfs[300];
+	FILE *f;
+	unsigned long size = 0;
+
+	snprintf(buf, sizeof(buf), "%s", path);
+	snprintf(sysfs, sizeof(sysfs), "/sys/class/uio/%s/maps/map0/size", basename(buf));
+	if ((f = fopen(sysfs, "r")) == NULL) {
+		perror(sysfs);
+		return 0;
+	}
+	if (fscanf(f, "%lx", &size) != 1) {
+		size = 0;
+	}
+	fclose(f);
+
+	return size;
+}
+
+int i2c_uio_open(const char *path)
+{
+	void *regs;
+
+	if ((uio_size = i2c_uio_map_size(path)) == 0) {
+		return -1;
+	}
+
+	if ((uio_fd = open(path, O_RDWR | O_SYNC)) == -1) {
+		perror("open");
+		return -1;
+	}
+
+	/* Map 0 is the register window */
+	regs = mmap(NULL, uio_size, PROT_READ | PROT_WRITE, MAP_SHARED, uio_fd, 0 * getpagesize());
+	if (regs == MAP_FAILED) {
+		perror("mmap");
+		close(uio_fd);
+		uio_fd = -1;
+		return -1;
+	}
+	uio_regs = regs;
+
+	return 0;
+}
+
+void i2c_uio_close(void)
+{
+	munmap((void *)uio_regs, uio_size);
+	close(uio_fd);
+	uio_fd = -1;
+}
+
+int i2c_uio_wait_irq(uint32_t *cause)
+{
+	uint32_t count;
+	uint32_t pending;
+	ssize_t n;
+
+	/* Returns at once if the IRQ has fired since the previous wait */
+	while ((n = read(uio_fd, &count, sizeof(count))) != sizeof(count)) {
+		if (n == -1 && errno == EINTR) {
+			continue;
+		}
+		return n == -1 ? -errno : -EIO;
+	}
+
+	/*
+	 * Acknowledge the channels that raised it. The line is the OR of the
+	 * causes and only its rising edge is seen, keep going until none is left
+	 * or a channel raising it meanwhile would never be waited for.
+	 */
+	*cause = 0;
+	while ((pending = axi_master_read(i2c_irq_cause_addr)) != 0) {
+		axi_master_write(i2c_irq_cause_addr, pending);
+		*cause |= pending;
+	}
+
+	return 0;
+}
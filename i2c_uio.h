@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Userspace backend for i2c_mem.h on top of the zzz-i2c-uio kernel module.
+ * Registers are mmap:ed so that axi_master_read/write are plain loads and
+ * stores, no system calls involved. Waiting for the IRQ is a blocking read.
+ */
+
+/* Map the controller behind a UIO device such as "/dev/uio0", returns -1 on error */
+int i2c_uio_open(const char *path);
+void i2c_uio_close(void);
+
+/*
+ * Block until the controller raises its IRQ, acknowledge it and store the IRQ
+ * cause (one bit per channel) in *cause. Returns 0 or a negative errno value.
+ */
+int i2c_uio_wait_irq(uint32_t *cause);
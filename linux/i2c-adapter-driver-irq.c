@@ -0,0 +1,463 @@
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/irqdomain.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/platform_device.h>
+#include <linux/of_address.h>
+#include <linux/of_irq.h>
+#include <linux/device.h>
+#include <linux/i2c.h>
+#include <linux/io.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/wait.h>
+
+/*
+ * Generic I2C bus driver for the controller, registers one i2c_adapter per
+ * channel so that in-tree client drivers (at24, sensors, i2c-dev, ...) can be
+ * used instead of one-off drivers per device.
+ *
+ * A whole i2c_msg array is run by the IRQ handler, one byte per interrupt and
+ * with repeated starts between messages, the caller only sleeps until it is
+ * done.
+ */
+
+#define DEVICE_NAME "zzz-i2c"
+
+#define MAX_CHANNELS 15
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Markus Lavin (https://www.zzzconsulting.se)");
+MODULE_DESCRIPTION("I2C bus driver for the I2C controller tutorial posts from https://www.zzzconsulting.se/");
+MODULE_VERSION("0.1");
+
+static const uint32_t i2c_chan_stride = 0x100;
+
+static const uint32_t i2c_ctrl_addr = 0x00c;
+static const uint32_t i2c_status_addr = 0x010;
+static const uint32_t i2c_abort_addr = 0x01c;
+static const uint32_t i2c_irq_cause_addr = 0xf00;
+static const uint32_t i2c_num_chan_addr = 0xf04;
+
+static const uint32_t i2c_ctrl_nack_bit = 1 << 12;
+static const uint32_t i2c_ctrl_stop_only_bit = 1 << 11;
+static const uint32_t i2c_ctrl_we_bit = 1 << 10;
+static const uint32_t i2c_ctrl_start_bit = 1 << 9;
+static const uint32_t i2c_ctrl_stop_bit = 1 << 8;
+
+static const uint32_t i2c_status_busy_bit = 1 << 9;
+static const uint32_t i2c_status_ack_bit = 1 << 8;
+static const uint32_t i2c_status_stuck_bit = 1 << 12;
+
+enum zzz_i2c_state {S_IDLE, S_ADDR, S_DATA, S_STOP, S_RECOVER};
+
+struct zzz_i2c;
+
+struct zzz_i2c_chan {
+	struct i2c_adapter adap;
+	struct i2c_bus_recovery_info rinfo;
+	struct zzz_i2c *priv;
+	void __iomem *base;
+	wait_queue_head_t wq;
+
+	/* Transfer in progress, owned by the IRQ handler until done is set */
+	struct i2c_msg *msgs;
+	int num;
+	int msg_idx;
+	int byte_idx;
+	enum zzz_i2c_state state;
+	bool stopped;
+	bool done;
+	int err;
+};
+
+struct zzz_i2c {
+	struct device *dev;
+	void __iomem *io_base;
+	int irq_num;
+	spinlock_t lock;
+	int num_chan;
+	struct zzz_i2c_chan chan[];
+};
+
+static void zzz_i2c_cmd(struct zzz_i2c_chan *ch, uint32_t ctrl)
+{
+	ch->stopped = ctrl & (i2c_ctrl_stop_bit | i2c_ctrl_stop_only_bit);
+	writel(ctrl, ch->base + i2c_ctrl_addr);
+}
+
+static void zzz_i2c_done(struct zzz_i2c_chan *ch, int err)
+{
+	ch->err = err;
+	ch->state = S_IDLE;
+	ch->done = true;
+	wake_up(&ch->wq);
+}
+
+static void zzz_i2c_abort(struct zzz_i2c_chan *ch, int err)
+{
+	if (ch->stopped) {
+		zzz_i2c_done(ch, err);
+		return;
+	}
+
+	/* Release the bus with a lone stop */
+	ch->err = err;
+	ch->state = S_STOP;
+	zzz_i2c_cmd(ch, i2c_ctrl_stop_only_bit);
+}
+
+/* Address the device for the current message, with a (repeated) start */
+static void zzz_i2c_start(struct zzz_i2c_chan *ch)
+{
+	struct i2c_msg *msg = &ch->msgs[ch->msg_idx];
+	uint32_t ctrl = i2c_ctrl_we_bit | i2c_ctrl_start_bit | msg->addr << 1 | ((msg->flags & I2C_M_RD) ? 1 : 0) << 0;
+
+	/* Nothing follows a zero length last message (e.g. SMBus quick) */
+	if (msg->len == 0 && ch->msg_idx + 1 == ch->num)
+		ctrl |= i2c_ctrl_stop_bit;
+
+	ch->state = S_ADDR;
+	zzz_i2c_cmd(ch, ctrl);
+}
+
+/* Issue the next byte of the transfer, the bus is idle when called */
+static void zzz_i2c_next(struct zzz_i2c_chan *ch)
+{
+	struct i2c_msg *msg = &ch->msgs[ch->msg_idx];
+	bool last_msg = ch->msg_idx + 1 == ch->num;
+
+	if (ch->byte_idx < msg->len) {
+		bool last = ch->byte_idx + 1 == msg->len;
+		uint32_t ctrl = (last && last_msg) ? i2c_ctrl_stop_bit : 0;
+
+		if (msg->flags & I2C_M_RD)
+			ctrl |= last ? i2c_ctrl_nack_bit : 0;
+		else
+			ctrl |= i2c_ctrl_we_bit | msg->buf[ch->byte_idx];
+
+		ch->state = S_DATA;
+		zzz_i2c_cmd(ch, ctrl);
+		return;
+	}
+
+	/* Message complete, the next one begins with a repeated start */
+	ch->msg_idx++;
+	ch->byte_idx = 0;
+	if (ch->msg_idx < ch->num) {
+		zzz_i2c_start(ch);
+		return;
+	}
+
+	/* The stop went out together with the last byte */
+	zzz_i2c_done(ch, 0);
+}
+
+static void zzz_i2c_chan_irq(struct zzz_i2c_chan *ch)
+{
+	uint32_t status = readl(ch->base + i2c_status_addr);
+	struct i2c_msg *msg;
+
+	if (ch->state == S_IDLE) {
+		/* Interrupts are not expected while in this state */
+		dev_warn_ratelimited(&ch->adap.dev, "unexpected interrupt\n");
+		return;
+	}
+	if (ch->state == S_RECOVER) {
+		/* Raised before the abort unless the controller is idle again */
+		if (!(status & i2c_status_busy_bit))
+			zzz_i2c_done(ch, ch->err);
+		return;
+	}
+	if (status & i2c_status_busy_bit) {
+		dev_err(&ch->adap.dev, "IRQ while busy\n");
+		zzz_i2c_done(ch, -EIO);
+		return;
+	}
+
+	switch (ch->state) {
+	case S_IDLE:
+	case S_RECOVER:
+		break;
+
+	case S_ADDR:
+		if (~status & i2c_status_ack_bit) {
+			/* Nobody home */
+			zzz_i2c_abort(ch, -ENXIO);
+			return;
+		}
+		zzz_i2c_next(ch);
+		break;
+
+	case S_DATA:
+		msg = &ch->msgs[ch->msg_idx];
+		if (msg->flags & I2C_M_RD) {
+			msg->buf[ch->byte_idx] = status & 0xff;
+		}
+		else if (~status & i2c_status_ack_bit) {
+			zzz_i2c_abort(ch, -EIO);
+			return;
+		}
+		ch->byte_idx++;
+		zzz_i2c_next(ch);
+		break;
+
+	case S_STOP:
+		zzz_i2c_done(ch, ch->err);
+		break;
+	}
+}
+
+static irqreturn_t zzz_i2c_irq(int irq, void *dev_id)
+{
+	struct zzz_i2c *priv = dev_id;
+	irqreturn_t ret = IRQ_NONE;
+	uint32_t cause;
+	int i;
+
+	spin_lock(&priv->lock);
+
+	/*
+	 * Channels share the (edge triggered) IRQ line, keep going until no
+	 * cause is left or an IRQ raised meanwhile would be lost
+	 */
+	while ((cause = readl(priv->io_base + i2c_irq_cause_addr)) != 0) {
+		/* Acknowledge before issuing next command as that will raise it again */
+		writel(cause, priv->io_base + i2c_irq_cause_addr);
+
+		for (i = 0; i < priv->num_chan; i++) {
+			if (cause & BIT(i))
+				zzz_i2c_chan_irq(&priv->chan[i]);
+		}
+		ret = IRQ_HANDLED;
+	}
+
+	spin_unlock(&priv->lock);
+
+	return ret;
+}
+
+/*
+ * Bus recovery for i2c_recover_bus(), done by the controller: it drops
+ * whatever the channel is doing, clocks SCL until a slave driving SDA lets go
+ * of it and sends a stop, then raises an IRQ. Returns once the controller is
+ * idle again.
+ */
+static int zzz_i2c_recover_bus(struct i2c_adapter *adap)
+{
+	struct zzz_i2c_chan *ch = i2c_get_adapdata(adap);
+	unsigned long flags;
+	uint32_t status;
+
+	spin_lock_irqsave(&ch->priv->lock, flags);
+	ch->state = S_RECOVER;
+	ch->done = false;
+	writel(1, ch->base + i2c_abort_addr);
+	spin_unlock_irqrestore(&ch->priv->lock, flags);
+
+	/* The controller gives up on SCL held low by itself, so this is a lost IRQ */
+	if (!wait_event_timeout(ch->wq, ch->done, adap->timeout))
+		dev_err(&adap->dev, "bus recovery timed out\n");
+
+	spin_lock_irqsave(&ch->priv->lock, flags);
+	status = readl(ch->base + i2c_status_addr);
+	ch->state = S_IDLE;
+	ch->done = true;
+	spin_unlock_irqrestore(&ch->priv->lock, flags);
+
+	if (status & i2c_status_busy_bit) {
+		dev_err(&adap->dev, "controller still busy after bus recovery\n");
+		return -EBUSY;
+	}
+	if (status & i2c_status_stuck_bit) {
+		dev_err(&adap->dev, "bus recovery failed, SCL held low\n");
+		return -EBUSY;
+	}
+
+	return 0;
+}
+
+static int zzz_i2c_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs, int num)
+{
+	struct zzz_i2c_chan *ch = i2c_get_adapdata(adap);
+	unsigned long flags;
+	bool timed_out;
+	int err;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		if (msgs[i].flags & I2C_M_TEN)
+			return -EOPNOTSUPP;
+	}
+
+	/* Left over from a transfer that was given up on */
+	if ((readl(ch->base + i2c_status_addr) & i2c_status_busy_bit) && i2c_recover_bus(adap))
+		return -EBUSY;
+
+	spin_lock_irqsave(&ch->priv->lock, flags);
+	ch->msgs = msgs;
+	ch->num = num;
+	ch->msg_idx = 0;
+	ch->byte_idx = 0;
+	ch->err = 0;
+	ch->done = false;
+	zzz_i2c_start(ch);
+	spin_unlock_irqrestore(&ch->priv->lock, flags);
+
+	wait_event_timeout(ch->wq, ch->done, adap->timeout);
+
+	spin_lock_irqsave(&ch->priv->lock, flags);
+	timed_out = !ch->done;
+	err = timed_out ? -ETIMEDOUT : ch->err;
+	spin_unlock_irqrestore(&ch->priv->lock, flags);
+
+	/* The controller may still be busy or a slave holding SDA, not returned before that is sorted */
+	if (timed_out) {
+		dev_err(&adap->dev, "transfer timed out, recovering bus\n");
+		i2c_recover_bus(adap);
+	}
+
+	return err ? err : num;
+}
+
+static u32 zzz_i2c_func(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C | I2C_FUNC_SMBUS_EMUL;
+}
+
+static const struct i2c_algorithm zzz_i2c_algo = {
+	.master_xfer = zzz_i2c_xfer,
+	.functionality = zzz_i2c_func,
+};
+
+/* With several channels the client devices of channel n sit below child node n */
+static struct device_node *zzz_i2c_chan_node(struct device_node *np, int num_chan, int i)
+{
+	struct device_node *child;
+	u32 reg;
+
+	if (num_chan == 1)
+		return np;
+
+	for_each_available_child_of_node(np, child) {
+		if (!of_property_read_u32(child, "reg", &reg) && reg == i)
+			return child;
+	}
+
+	return NULL;
+}
+
+static int __zzz_driver_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct device_node *np = dev->of_node;
+	struct zzz_i2c *priv;
+	struct resource res;
+	void __iomem *io_base;
+	int num_chan;
+	int ret;
+	int i;
+
+	if ((ret = of_address_to_resource(np, 0, &res))) {
+		dev_err(dev, "probe: of_address_to_resource: %d\n", ret);
+		return ret;
+	}
+
+	io_base = devm_ioremap(dev, res.start, resource_size(&res));
+	if (!io_base)
+		return -ENOMEM;
+
+	num_chan = readl(io_base + i2c_num_chan_addr);
+	if (num_chan < 1 || num_chan > MAX_CHANNELS) {
+		dev_err(dev, "probe: bad number of channels %d\n", num_chan);
+		return -ENODEV;
+	}
+
+	priv = devm_kzalloc(dev, sizeof(*priv) + num_chan * sizeof(priv->chan[0]), GFP_KERNEL);
+	if (!priv)
+		return -ENOMEM;
+
+	priv->dev = dev;
+	priv->io_base = io_base;
+	priv->num_chan = num_chan;
+	spin_lock_init(&priv->lock);
+
+	for (i = 0; i < num_chan; i++) {
+		struct zzz_i2c_chan *ch = &priv->chan[i];
+
+		ch->priv = priv;
+		ch->base = io_base + i * i2c_chan_stride;
+		ch->state = S_IDLE;
+		init_waitqueue_head(&ch->wq);
+
+		ch->adap.owner = THIS_MODULE;
+		ch->adap.algo = &zzz_i2c_algo;
+		ch->adap.timeout = HZ;
+		ch->adap.dev.parent = dev;
+		ch->adap.dev.of_node = zzz_i2c_chan_node(np, num_chan, i);
+		ch->rinfo.recover_bus = zzz_i2c_recover_bus;
+		ch->adap.bus_recovery_info = &ch->rinfo;
+		snprintf(ch->adap.name, sizeof(ch->adap.name), DEVICE_NAME " channel %d", i);
+		i2c_set_adapdata(&ch->adap, ch);
+	}
+
+	priv->irq_num = irq_of_parse_and_map(np, 0);
+
+	dev_info(dev, "probe: irq_num=%d num_chan=%d\n", priv->irq_num, num_chan);
+
+	if ((ret = request_irq(priv->irq_num, zzz_i2c_irq, IRQF_TRIGGER_RISING, DEVICE_NAME, priv))) {
+		dev_err(dev, "probe: request_irq: %d\n", ret);
+		goto err_dispose;
+	}
+
+	for (i = 0; i < num_chan; i++) {
+		if ((ret = i2c_add_adapter(&priv->chan[i].adap))) {
+			dev_err(dev, "probe: i2c_add_adapter: %d\n", ret);
+			goto err_del;
+		}
+	}
+
+	platform_set_drvdata(pdev, priv);
+
+	return 0;
+
+err_del:
+	while (--i >= 0)
+		i2c_del_adapter(&priv->chan[i].adap);
+	free_irq(priv->irq_num, priv);
+err_dispose:
+	irq_dispose_mapping(priv->irq_num);
+	return ret;
+}
+
+static int __zzz_driver_remove(struct platform_device *pdev)
+{
+	struct zzz_i2c *priv = platform_get_drvdata(pdev);
+	int i;
+
+	for (i = 0; i < priv->num_chan; i++)
+		i2c_del_adapter(&priv->chan[i].adap);
+
+	free_irq(priv->irq_num, priv);
+	irq_dispose_mapping(priv->irq_num);
+
+	return 0;
+}
+
+static const struct of_device_id __zzz_driver_id[] = {
+	{.compatible = "zzz-i2c-controller"},
+	{}
+};
+
+static struct platform_driver __zzz_driver = {
+	.driver = {
+		.name = DEVICE_NAME,
+		.owner = THIS_MODULE,
+		.of_match_table = of_match_ptr(__zzz_driver_id),
+	},
+	.probe = __zzz_driver_probe,
+	.remove = __zzz_driver_remove
+};
+
+module_platform_driver(__zzz_driver);
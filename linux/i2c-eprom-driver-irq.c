@@ -7,296 +7,1176 @@
 #include <linux/of_address.h>
 #include <linux/of_irq.h>
 #include <linux/device.h>
+#include <linux/cdev.h>
+#include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/fs.h>
+#include <linux/idr.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
 #include <linux/uaccess.h>
+#include <linux/version.h>
+#include <linux/workqueue.h>
+
+#define CREATE_TRACE_POINTS
+#include "i2c-eprom-trace.h"
+#include "i2c-eprom-stats.h"
 
 #define DEVICE_NAME "zzz-i2c-eprom"
 #define CLASS_NAME "zzz"
 
+#define MAX_DEVICES 8
+
 #define MEM_SIZE 16
+#define EPROM_PAGE_SIZE 8
 #define I2C_ADDR 0x10
 
-#define assert(x)
-
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Markus Lavin (https://www.zzzconsulting.se)");
 MODULE_DESCRIPTION("Device driver for the I2C EPROM tutorial posts from https://www.zzzconsulting.se/");
 MODULE_VERSION("0.1");
 
-static char read_message[MEM_SIZE];
-static int read_idx;
-static int read_len;
-
-static char write_message[MEM_SIZE];
-static int write_idx;
-static int write_len;
+/*
+ * With the cache enabled reads are served from an in-kernel copy of the EPROM,
+ * filled at probe (or on first use without prefetch). Writes update the copy
+ * and mark the pages touched dirty, these are written back as whole pages
+ * writeback_ms later or on fsync. The copy can be mmap:ed read-only.
+ */
+static bool cache = true;
+module_param(cache, bool, 0444);
+MODULE_PARM_DESC(cache, "Serve reads and writes from an in-kernel copy of the EPROM (default: 1)");
+
+static bool prefetch = true;
+module_param(prefetch, bool, 0444);
+MODULE_PARM_DESC(prefetch, "Fill the cache at probe rather than on first use (default: 1)");
+
+static uint writeback_ms = 100;
+module_param(writeback_ms, uint, 0644);
+MODULE_PARM_DESC(writeback_ms, "Delay before dirty pages are written back in ms (default: 100)");
+
+static uint timeout_ms = 1000;
+module_param(timeout_ms, uint, 0644);
+MODULE_PARM_DESC(timeout_ms, "Time without progress before a transfer is aborted and the bus recovered in ms (default: 1000)");
+
+enum zzz_state {S_ILLEGAL, /* S_READ_0, */ S_READ_1, S_READ_2, S_READ_3, S_READ_4,
+                S_WRITE_0, S_WRITE_1, S_WRITE_2, S_WRITE_3, S_WRITE_4,
+                S_RECOVER};
+
+/*
+ * A read or write of the EPROM. Requests are queued on the device and run one
+ * at a time by the IRQ handler, which starts the next one as soon as the
+ * current one completes.
+ */
+struct zzz_req {
+	struct list_head list;
+	bool write;
+	int base;
+	int idx;
+	int len;
+	char data[MEM_SIZE];
+	int err;
+	struct completion done;
+	bool abandoned; /* Opener is gone, freed on completion */
+	ktime_t submitted;
+};
 
+/* Counters in debugfs, updated with the device lock held */
+struct zzz_stats {
+	struct lat_hist read_lat;
+	struct lat_hist write_lat;
+	u64 bytes_read;
+	u64 bytes_written;
+	u64 irqs;
+	u64 unexpected_irqs;
+	u64 nacks;
+	u64 errors;
+	u64 timeouts;
+};
 
-wait_queue_head_t wq;
+/*
+ * Open files keep the device around after the platform device is removed,
+ * through the reference the cdev holds on chr_dev. It is freed by the release
+ * of chr_dev once the last file is closed, until then every operation fails
+ * with ENODEV.
+ */
+struct zzz_dev {
+	struct device *dev;
+	void __iomem *io_base;
+	int irq_num;
+	int id;
+	struct cdev cdev;
+	struct device chr_dev;
+	bool removed; /* Set with both lock and cache_lock held */
+
+	/* Held by the IRQ thread while running the state machine */
+	struct mutex lock;
+	struct list_head queue;
+	struct zzz_req *cur;
+	enum zzz_state state;
+	unsigned long last_progress; /* jiffies */
+	wait_queue_head_t wq;
+
+	struct zzz_stats stats;
+	struct dentry *debugfs;
+
+	/* EPROM contents, one page so that it can be mmap:ed, mappings hold their own reference */
+	struct page *cache_page;
+	char *cache;
+	struct mutex cache_lock;
+	bool cache_valid;
+	struct zzz_req *fill_req;
+	unsigned long dirty; /* One bit per EPROM page */
+	int wb_err;          /* Write-back error, reported by fsync */
+	struct delayed_work wb_work;
+};
 
-static int irq_num;
+/*
+ * Per open file context. A file has at most one read and one write request in
+ * flight, with O_NONBLOCK these are collected by a later read or write.
+ */
+struct zzz_file {
+	struct zzz_dev *zdev;
+	struct mutex mutex;
+	struct zzz_req *rd_req;
+	struct zzz_req *wr_req;
+};
 
 static int majorNumber;
 static struct class *zzzClass  = NULL;
-static struct device *zzzDevice = NULL;
+static DEFINE_IDA(zzz_ida);
 
 static int dev_open(struct inode *, struct file *);
 static int dev_release(struct inode *, struct file *);
 static ssize_t dev_read(struct file *, char *, size_t, loff_t *);
 static ssize_t dev_write(struct file *, const char *, size_t, loff_t *);
+static __poll_t dev_poll(struct file *, poll_table *);
+static int dev_fsync(struct file *, loff_t, loff_t, int);
+static int dev_mmap(struct file *, struct vm_area_struct *);
 
 static struct file_operations fops =
 {
+	.owner = THIS_MODULE,
 	.open = dev_open,
 	.read = dev_read,
 	.write = dev_write,
+	.poll = dev_poll,
+	.fsync = dev_fsync,
+	.mmap = dev_mmap,
 	.release = dev_release,
 };
 
-static void __iomem *io_base = NULL;
-
-static void axi_master_write(uint32_t address, uint32_t data)
+static void axi_master_write(struct zzz_dev *zdev, uint32_t address, uint32_t data)
 {
-	writel(data, io_base + address);
+	writel(data, zdev->io_base + address);
 }
 
-static uint32_t axi_master_read(uint32_t address)
+static uint32_t axi_master_read(struct zzz_dev *zdev, uint32_t address)
 {
-	return readl(io_base + address);
+	return readl(zdev->io_base + address);
 }
 
 static const uint32_t i2c_ctrl_addr = 0x00c;
 static const uint32_t i2c_status_addr = 0x010;
+static const uint32_t i2c_abort_addr = 0x01c;
+static const uint32_t i2c_irq_ack_addr = 0x020;
+static const uint32_t i2c_seq_cmd_addr = 0x024;
+static const uint32_t i2c_seq_status_addr = 0x02c;
 
+static const uint32_t i2c_ctrl_nack_bit = 1 << 12;
 static const uint32_t i2c_ctrl_we_bit = 1 << 10;
 static const uint32_t i2c_ctrl_start_bit = 1 << 9;
 static const uint32_t i2c_ctrl_stop_bit = 1 << 8;
 
 static const uint32_t i2c_status_busy_bit = 1 << 9;
 static const uint32_t i2c_status_ack_bit = 1 << 8;
+static const uint32_t i2c_status_stuck_bit = 1 << 12;
+
+static const uint32_t i2c_seq_cmd_poll_bit = 1 << 25;
 
-static enum {S_ILLEGAL, /* S_READ_0, */ S_READ_1, S_READ_2, S_READ_3, S_READ_4,
-             S_WRITE_0, S_WRITE_1, S_WRITE_2, S_WRITE_3} state;
+static const uint32_t i2c_seq_status_poll_err_bit = 1 << 2;
+static const uint32_t i2c_seq_status_rej_err_bit = 1 << 5;
 
-static irq_handler_t zzz_irq_handler(unsigned int irq, void *dev_id, struct pt_regs *regs)
+/*
+ * The device auto increments its memory address so it is only addressed once
+ * per transfer. Reads then stream all bytes back to back, writes are split in
+ * page sized bursts each followed by a write cycle that is ACK polled in
+ * hardware.
+ */
+
+static void zzz_set_state(struct zzz_dev *zdev, enum zzz_state state)
+{
+	trace_zzz_eprom_state(zdev->id, zdev->state, state);
+	zdev->state = state;
+}
+
+/* Read byte at idx, NACK and stop after the last one */
+static void zzz_read_byte(struct zzz_dev *zdev, struct zzz_req *req)
+{
+	axi_master_write(zdev, i2c_ctrl_addr, req->idx + 1 == req->len ? i2c_ctrl_nack_bit | i2c_ctrl_stop_bit : 0);
+}
+
+/* Write byte at idx, stop at the end of the page or of the data */
+static void zzz_write_byte(struct zzz_dev *zdev, struct zzz_req *req)
+{
+	uint8_t mem_data = req->data[req->idx];
+	int last = req->idx + 1 == req->len || (req->base + req->idx + 1) % EPROM_PAGE_SIZE == 0;
+
+	axi_master_write(zdev, i2c_ctrl_addr, i2c_ctrl_we_bit | (last ? i2c_ctrl_stop_bit : 0) | mem_data);
+	zzz_set_state(zdev, last ? S_WRITE_3 : S_WRITE_2);
+	req->idx++;
+}
+
+/*
+ * Abort whatever the controller is doing and recover the bus, it raises an
+ * IRQ once done. Called with lock held.
+ */
+static void zzz_abort(struct zzz_dev *zdev)
+{
+	zzz_set_state(zdev, S_RECOVER);
+	zdev->last_progress = jiffies;
+	axi_master_write(zdev, i2c_abort_addr, 1);
+}
+
+/* Start the request at the head of the queue unless one is running, called with lock held */
+static void zzz_kick(struct zzz_dev *zdev)
+{
+	struct zzz_req *req;
+
+	if (zdev->cur || zdev->state == S_RECOVER || list_empty(&zdev->queue))
+		return;
+
+	/* A failed transfer may have left a byte behind, it would be queued ahead of ours */
+	if (axi_master_read(zdev, i2c_status_addr) & i2c_status_busy_bit) {
+		zzz_abort(zdev);
+		return;
+	}
+
+	req = list_first_entry(&zdev->queue, struct zzz_req, list);
+	list_del(&req->list);
+	zdev->cur = req;
+	zdev->last_progress = jiffies;
+
+	/* Address device for write mode, reads too begin with the memory address */
+	trace_zzz_eprom_req_start(zdev->id, req->write, req->base, req->len, 0);
+	zzz_set_state(zdev, req->write ? S_WRITE_1 : S_READ_1);
+	axi_master_write(zdev, i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 0 << 0);
+}
+
+/* Hand the result to the waiter, or free the request if there is none */
+static void zzz_req_finish(struct zzz_req *req, int err)
+{
+	req->err = err;
+	if (req->abandoned)
+		kfree(req);
+	else
+		complete(&req->done);
+}
+
+/* Complete the running request and go on with the next, called with lock held */
+static void zzz_complete(struct zzz_dev *zdev, int err)
+{
+	struct zzz_req *req = zdev->cur;
+
+	zdev->cur = NULL;
+	zzz_set_state(zdev, S_ILLEGAL);
+
+	trace_zzz_eprom_req_done(zdev->id, req->write, req->base, req->len, err);
+	if (err) {
+		zdev->stats.errors++;
+	}
+	else if (req->write) {
+		zdev->stats.bytes_written += req->len;
+		lat_hist_add(&zdev->stats.write_lat, req->submitted);
+	}
+	else {
+		/* Read latency is taken by dev_read, fills of the cache are not reads */
+		zdev->stats.bytes_read += req->len;
+	}
+
+	zzz_req_finish(req, err);
+
+	/* Wake up sleeping users blocked on poll */
+	wake_up_interruptible(&zdev->wq);
+
+	zzz_kick(zdev);
+}
+
+static void zzz_submit(struct zzz_dev *zdev, struct zzz_req *req)
+{
+	req->submitted = ktime_get();
+
+	mutex_lock(&zdev->lock);
+	if (zdev->removed) {
+		zzz_req_finish(req, -ENODEV);
+	}
+	else {
+		list_add_tail(&req->list, &zdev->queue);
+		zzz_kick(zdev);
+	}
+	mutex_unlock(&zdev->lock);
+}
+
+/*
+ * The platform device is going away, fail whatever is queued or running and
+ * stop touching the hardware. Called with lock held.
+ */
+static void zzz_shutdown(struct zzz_dev *zdev)
+{
+	struct zzz_req *req, *tmp;
+	LIST_HEAD(queue);
+
+	zdev->removed = true;
+	list_splice_init(&zdev->queue, &queue);
+
+	if (zdev->cur) {
+		/* Leave the bus released */
+		axi_master_write(zdev, i2c_abort_addr, 1);
+		zzz_complete(zdev, -ENODEV);
+	}
+
+	list_for_each_entry_safe(req, tmp, &queue, list) {
+		list_del(&req->list);
+		zzz_req_finish(req, -ENODEV);
+	}
+
+	wake_up_interruptible(&zdev->wq);
+}
+
+/* Drop a request of a file that is going away, in flight ones are freed on completion */
+static void zzz_abandon(struct zzz_dev *zdev, struct zzz_req *req)
+{
+	if (!req)
+		return;
+
+	mutex_lock(&zdev->lock);
+	if (completion_done(&req->done))
+		kfree(req);
+	else
+		req->abandoned = true;
+	mutex_unlock(&zdev->lock);
+}
+
+/* Bus recovery is over, fail the transfer it was for and go on with the queue, called with lock held */
+static void zzz_recover_done(struct zzz_dev *zdev, uint32_t status)
+{
+	if (status & i2c_status_stuck_bit)
+		dev_err(zdev->dev, "Bus recovery failed, SCL held low\n");
+
+	zzz_set_state(zdev, S_ILLEGAL);
+	if (zdev->cur)
+		zzz_complete(zdev, -ETIMEDOUT);
+	else
+		zzz_kick(zdev);
+}
+
+/*
+ * Abort the running transfer if it has not made progress for timeout_ms, for
+ * instance due to a lost IRQ or a slave holding the bus. The controller drops
+ * the transfer, clocks SCL until a slave left driving SDA low in the middle of
+ * a byte lets go of it and sends a stop. The transfer completes with ETIMEDOUT
+ * once the controller is idle again, nothing new is started before that.
+ */
+static void zzz_recover(struct zzz_dev *zdev)
 {
 	uint32_t status;
-	uint8_t mem_addr;
-	uint8_t mem_data = write_message[write_idx];
+
+	mutex_lock(&zdev->lock);
+
+	if (zdev->removed || (!zdev->cur && zdev->state != S_RECOVER) ||
+	    time_before(jiffies, zdev->last_progress + msecs_to_jiffies(timeout_ms)))
+		goto out;
+
+	zdev->stats.timeouts++;
+
+	if (zdev->state == S_RECOVER) {
+		/* The controller bounds the recovery itself, so it is the IRQ that went missing */
+		status = axi_master_read(zdev, i2c_status_addr);
+		if (status & i2c_status_busy_bit) {
+			dev_err(zdev->dev, "Bus recovery timed out, aborting again\n");
+			zzz_abort(zdev);
+		}
+		else {
+			zzz_recover_done(zdev, status);
+		}
+		goto out;
+	}
+
+	dev_err(zdev->dev, "Transfer timed out in state %d, recovering bus\n", zdev->state);
+	zzz_abort(zdev);
+
+out:
+	mutex_unlock(&zdev->lock);
+}
+
+/* Wait for request to complete, or tell if it has not with O_NONBLOCK */
+static int zzz_req_wait(struct zzz_dev *zdev, struct zzz_req *req, bool nonblock)
+{
+	long ret;
+
+	if (nonblock)
+		return completion_done(&req->done) ? 0 : -EAGAIN;
+
+	while (!(ret = wait_for_completion_interruptible_timeout(&req->done, msecs_to_jiffies(timeout_ms))))
+		zzz_recover(zdev);
+
+	return ret < 0 ? ret : 0;
+}
+
+/* Same as zzz_req_wait but not interruptible, for requests issued by the driver itself */
+static void zzz_req_sync(struct zzz_dev *zdev, struct zzz_req *req)
+{
+	while (!wait_for_completion_timeout(&req->done, msecs_to_jiffies(timeout_ms)))
+		zzz_recover(zdev);
+}
+
+/* Hard IRQ context, only acknowledge and leave the rest to the thread */
+static irqreturn_t zzz_irq_handler(int irq, void *dev_id)
+{
+	struct zzz_dev *zdev = dev_id;
 
 	/* Acknowledge interrupt */
-	writel(0xffff, io_base + 0x20);
+	axi_master_write(zdev, i2c_irq_ack_addr, 0xffff);
 
-	status = axi_master_read(i2c_status_addr);
+	return IRQ_WAKE_THREAD;
+}
 
-	if (status & i2c_status_busy_bit) {
-		printk(KERN_ALERT "zzz-i2c-eprom: IRQ while busy");
-		state = S_ILLEGAL;
+static irqreturn_t zzz_irq_thread(int irq, void *dev_id)
+{
+	struct zzz_dev *zdev = dev_id;
+	struct zzz_req *req;
+	uint32_t status;
+	uint8_t mem_addr;
+
+	mutex_lock(&zdev->lock);
+
+	/* Whatever was running has been failed already */
+	if (zdev->removed)
+		goto done_with_irq;
+
+	req = zdev->cur;
+	zdev->last_progress = jiffies;
+
+	status = axi_master_read(zdev, i2c_status_addr);
+
+	trace_zzz_eprom_irq(zdev->id, zdev->state, status);
+	zdev->stats.irqs++;
+
+	if (zdev->state == S_ILLEGAL) {
+		/* Interrupts are not expected while in this state */
+		dev_alert(zdev->dev, "Unexpected interrupt\n");
+		zdev->stats.unexpected_irqs++;
 		goto done_with_irq;
 	}
-	if (~status & i2c_status_ack_bit) {
-		printk(KERN_ALERT "zzz-i2c-eprom: No ACK");
-		state = S_ILLEGAL;
+	if (zdev->state == S_RECOVER) {
+		/* Bus released after an abort, unless this one was raised before it */
+		if (!(status & i2c_status_busy_bit))
+			zzz_recover_done(zdev, status);
 		goto done_with_irq;
 	}
+	if (status & i2c_status_busy_bit) {
+		dev_alert(zdev->dev, "IRQ while busy\n");
+		goto fail;
+	}
+	/*
+	 * Except for read data, which is ACKed by us, all bytes should be ACKed.
+	 * The write cycle ACK poll ends on a NACK when it gives up, its own
+	 * status tells.
+	 */
+	if (zdev->state != S_READ_4 && zdev->state != S_WRITE_4 && (~status & i2c_status_ack_bit)) {
+		dev_alert(zdev->dev, "No ACK\n");
+		trace_zzz_eprom_nack(zdev->id, zdev->state, status);
+		zdev->stats.nacks++;
+		goto fail;
+	}
 
-	switch (state) {
+	switch (zdev->state) {
 	case S_ILLEGAL:
-		/* Interrupts are not expected while in this state */
-		printk(KERN_ALERT "zzz-i2c-eprom: Unexpected interrupt");
-		goto done_with_irq;
+	case S_RECOVER:
 		break;
 
 	case S_READ_1:
 		/* Memory address */
-		mem_addr = read_idx;
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
-		state = S_READ_2;
+		mem_addr = req->base;
+		axi_master_write(zdev, i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+		zzz_set_state(zdev, S_READ_2);
 		break;
 
 	case S_READ_2:
 		/* Address for read mode */
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 1 << 0);
-		state = S_READ_3;
+		axi_master_write(zdev, i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 1 << 0);
+		zzz_set_state(zdev, S_READ_3);
 		break;
 
 	case S_READ_3:
-		/* Memory data */
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_stop_bit);
-		state = S_READ_4;
+		/* First memory data */
+		zzz_read_byte(zdev, req);
+		zzz_set_state(zdev, S_READ_4);
 		break;
 
 	case S_READ_4:
-		read_message[read_idx] = status & 0xff;
-		if (read_idx + 1 < read_len) {
-			read_idx++;
-			/* Address device for write mode */
-			axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 0 << 0);
-			state = S_READ_1;
+		req->data[req->idx] = status & 0xff;
+		if (req->idx + 1 < req->len) {
+			/* Next memory data, address auto incremented by the device */
+			req->idx++;
+			zzz_read_byte(zdev, req);
 		}
 		else {
-			/* Wake up sleeping user blocked on read */
-			state = S_ILLEGAL;
-			wake_up_interruptible(&wq);
+			zzz_complete(zdev, 0);
 		}
 		break;
 
 	case S_WRITE_0:
 		/* I2C address device for write mode */
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 0 << 0);
-		state = S_WRITE_1;
+		axi_master_write(zdev, i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 0 << 0);
+		zzz_set_state(zdev, S_WRITE_1);
 		break;
 
 	case S_WRITE_1:
 		/* Memory address */
-		mem_addr = write_idx;
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
-		state = S_WRITE_2;
+		mem_addr = req->base + req->idx;
+		axi_master_write(zdev, i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+		zzz_set_state(zdev, S_WRITE_2);
 		break;
 
 	case S_WRITE_2:
-		/* Memory data */
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_stop_bit | mem_data);
-		state = S_WRITE_3;
-		if (write_idx + 1 < write_len) {
-			/* prepare new data and address */
-			write_idx++;
-			state = S_WRITE_0; /* Actually quite possible the device has
-								  internal auto increment on address in which
-								  case we can go directly to S_WRITE_2 */
-		}
-		else {
-			state = S_WRITE_3;
-		}
+		/* Memory data, the page burst ends with a stop */
+		zzz_write_byte(zdev, req);
 		break;
 
 	case S_WRITE_3:
-		/* Wake up sleeping user blocked on write */
-		state = S_ILLEGAL;
-		wake_up_interruptible(&wq);
+		/* Burst complete, let hardware ACK poll until the write cycle is done */
+		axi_master_write(zdev, i2c_seq_cmd_addr, i2c_seq_cmd_poll_bit | I2C_ADDR);
+		if (axi_master_read(zdev, i2c_seq_status_addr) & i2c_seq_status_rej_err_bit) {
+			/* No IRQ is coming for a command that did not run */
+			dev_alert(zdev->dev, "ACK poll command rejected, controller busy\n");
+			goto fail;
+		}
+		zzz_set_state(zdev, S_WRITE_4);
+		break;
+
+	case S_WRITE_4:
+		if (axi_master_read(zdev, i2c_seq_status_addr) & i2c_seq_status_poll_err_bit) {
+			dev_alert(zdev->dev, "Write cycle ACK poll timeout\n");
+			zzz_complete(zdev, -ETIMEDOUT);
+			break;
+		}
+		if (req->idx < req->len) {
+			/* Next page, the poll left the bus stopped */
+			axi_master_write(zdev, i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 0 << 0);
+			zzz_set_state(zdev, S_WRITE_1);
+		}
+		else {
+			zzz_complete(zdev, 0);
+		}
 		break;
 	}
 
 done_with_irq:
+	mutex_unlock(&zdev->lock);
+
+	return IRQ_HANDLED;
+
+fail:
+	/* Abandon transfer and let the user see the error */
+	zzz_complete(zdev, -EIO);
+	mutex_unlock(&zdev->lock);
 
-	return (irq_handler_t)IRQ_HANDLED;
+	return IRQ_HANDLED;
 }
 
-static int __zzz_driver_probe(struct platform_device *pdev)
+static struct zzz_req *zzz_req_alloc(bool write, loff_t offset, size_t len)
 {
-	struct device *dev = &pdev->dev;
-	struct device_node *np = dev->of_node;
-	struct resource res;
+	struct zzz_req *req = kzalloc(sizeof(*req), GFP_KERNEL);
+
+	if (req) {
+		req->write = write;
+		req->base = offset;
+		req->len = len;
+		init_completion(&req->done);
+	}
+	return req;
+}
+
+/* Start filling the cache unless already done or under way, called with cache lock held */
+static int zzz_cache_fill_start(struct zzz_dev *zdev)
+{
+	if (zdev->cache_valid || zdev->fill_req)
+		return 0;
+
+	zdev->fill_req = zzz_req_alloc(false, 0, MEM_SIZE);
+	if (!zdev->fill_req)
+		return -ENOMEM;
+
+	zzz_submit(zdev, zdev->fill_req);
+
+	return 0;
+}
+
+/* Lock the cache and make sure it is filled, the lock is not held on error */
+static int zzz_cache_lock(struct zzz_dev *zdev, bool nonblock)
+{
+	struct zzz_req *req;
 	int ret;
 
-	init_waitqueue_head(&wq);
-	state = S_ILLEGAL;
+	if ((ret = mutex_lock_interruptible(&zdev->cache_lock)))
+		return ret;
+
+	if (zdev->removed) {
+		ret = -ENODEV;
+		goto err;
+	}
+
+	if (zdev->cache_valid)
+		return 0;
+
+	if ((ret = zzz_cache_fill_start(zdev)))
+		goto err;
+
+	req = zdev->fill_req;
+	if ((ret = zzz_req_wait(zdev, req, nonblock)))
+		goto err;
+
+	/* Failed fills are retried by the next user */
+	zdev->fill_req = NULL;
+	ret = req->err;
+	if (!ret) {
+		memcpy(zdev->cache, req->data, MEM_SIZE);
+		zdev->cache_valid = true;
+	}
+	kfree(req);
+	if (ret)
+		goto err;
+
+	return 0;
+
+err:
+	mutex_unlock(&zdev->cache_lock);
+	return ret;
+}
+
+/* Write back dirty pages, called with cache lock held */
+static void zzz_cache_flush(struct zzz_dev *zdev)
+{
+	struct zzz_req *req;
+	int page;
+
+	for_each_set_bit(page, &zdev->dirty, MEM_SIZE / EPROM_PAGE_SIZE) {
+		req = zzz_req_alloc(true, page * EPROM_PAGE_SIZE, EPROM_PAGE_SIZE);
+		if (!req) {
+			zdev->wb_err = -ENOMEM;
+			break;
+		}
+		memcpy(req->data, zdev->cache + req->base, req->len);
+		clear_bit(page, &zdev->dirty);
+
+		zzz_submit(zdev, req);
+		zzz_req_sync(zdev, req);
+
+		if (req->err) {
+			/* Keep it dirty and have the next flush try again */
+			set_bit(page, &zdev->dirty);
+			zdev->wb_err = req->err;
+		}
+		kfree(req);
+	}
+}
+
+static void zzz_wb_work(struct work_struct *work)
+{
+	struct zzz_dev *zdev = container_of(to_delayed_work(work), struct zzz_dev, wb_work);
+
+	mutex_lock(&zdev->cache_lock);
+	if (!zdev->removed)
+		zzz_cache_flush(zdev);
+	mutex_unlock(&zdev->cache_lock);
+}
+
+static void zzz_read_lat_add(struct zzz_dev *zdev, ktime_t start)
+{
+	mutex_lock(&zdev->lock);
+	lat_hist_add(&zdev->stats.read_lat, start);
+	mutex_unlock(&zdev->lock);
+}
 
-	irq_num = irq_of_parse_and_map(np, 0);
+static ssize_t zzz_cache_read(struct zzz_dev *zdev, bool nonblock, char *buffer, size_t len, loff_t *offset)
+{
+	ktime_t start = ktime_get();
+	ssize_t ret;
 
-	dev_info(dev, "probe: irq_num=%d\n", irq_num);
+	if (*offset >= MEM_SIZE || len == 0)
+		return 0;
 
-	if ((ret = request_irq(irq_num, (irq_handler_t) zzz_irq_handler, IRQF_TRIGGER_RISING, DEVICE_NAME, dev))) {
-		dev_err(dev, "probe: request_irq: %d\n", ret);
+	if ((ret = zzz_cache_lock(zdev, nonblock)))
 		return ret;
+
+	len = min(len, (size_t)(MEM_SIZE - *offset));
+	len = len - copy_to_user(buffer, zdev->cache + *offset, len);
+	*offset += len;
+
+	mutex_unlock(&zdev->cache_lock);
+
+	zzz_read_lat_add(zdev, start);
+
+	return len;
+}
+
+static ssize_t zzz_cache_write(struct zzz_dev *zdev, bool nonblock, const char *buffer, size_t len, loff_t *offset)
+{
+	int page;
+	ssize_t ret;
+
+	if (*offset >= MEM_SIZE || len == 0)
+		return 0;
+
+	/* Pages are written back whole, so the rest of them must be known */
+	if ((ret = zzz_cache_lock(zdev, nonblock)))
+		return ret;
+
+	len = min(len, (size_t)(MEM_SIZE - *offset));
+	len = len - copy_from_user(zdev->cache + *offset, buffer, len);
+
+	for (page = *offset / EPROM_PAGE_SIZE; page * EPROM_PAGE_SIZE < *offset + len; page++)
+		set_bit(page, &zdev->dirty);
+
+	*offset += len;
+
+	mutex_unlock(&zdev->cache_lock);
+
+	/* Writes within the delay are coalesced into one write-back */
+	if (len)
+		schedule_delayed_work(&zdev->wb_work, msecs_to_jiffies(writeback_ms));
+
+	return len;
+}
+
+/* Statistics in /sys/kernel/debug/<platform device>/ */
+static void zzz_debugfs_init(struct zzz_dev *zdev)
+{
+	struct dentry *d = debugfs_create_dir(dev_name(zdev->dev), NULL);
+
+	zdev->debugfs = d;
+	debugfs_create_file("read_latency", 0444, d, &zdev->stats.read_lat, &lat_hist_fops);
+	debugfs_create_file("write_latency", 0444, d, &zdev->stats.write_lat, &lat_hist_fops);
+	debugfs_create_u64("bytes_read", 0444, d, &zdev->stats.bytes_read);
+	debugfs_create_u64("bytes_written", 0444, d, &zdev->stats.bytes_written);
+	debugfs_create_u64("irqs", 0444, d, &zdev->stats.irqs);
+	debugfs_create_u64("unexpected_irqs", 0444, d, &zdev->stats.unexpected_irqs);
+	debugfs_create_u64("nacks", 0444, d, &zdev->stats.nacks);
+	debugfs_create_u64("errors", 0444, d, &zdev->stats.errors);
+	debugfs_create_u64("timeouts", 0444, d, &zdev->stats.timeouts);
+}
+
+static void zzz_dev_release(struct device *dev)
+{
+	struct zzz_dev *zdev = dev_get_drvdata(dev);
+
+	/* A write racing with remove may have scheduled one more write-back */
+	cancel_delayed_work_sync(&zdev->wb_work);
+	if (zdev->cache_page)
+		put_page(zdev->cache_page);
+	kfree(zdev);
+}
+
+static int __zzz_driver_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct device_node *np = dev->of_node;
+	struct zzz_dev *zdev;
+	struct resource res;
+	int ret;
+
+	zdev = kzalloc(sizeof(*zdev), GFP_KERNEL);
+	if (!zdev)
+		return -ENOMEM;
+
+	/* From here on freed by zzz_dev_release */
+	device_initialize(&zdev->chr_dev);
+	zdev->chr_dev.class = zzzClass;
+	zdev->chr_dev.parent = dev;
+	zdev->chr_dev.release = zzz_dev_release;
+	dev_set_drvdata(&zdev->chr_dev, zdev);
+
+	zdev->dev = dev;
+	zdev->state = S_ILLEGAL;
+	mutex_init(&zdev->lock);
+	INIT_LIST_HEAD(&zdev->queue);
+	init_waitqueue_head(&zdev->wq);
+	mutex_init(&zdev->cache_lock);
+	INIT_DELAYED_WORK(&zdev->wb_work, zzz_wb_work);
+
+	BUILD_BUG_ON(MEM_SIZE > PAGE_SIZE);
+	if (cache) {
+		zdev->cache_page = alloc_page(GFP_KERNEL | __GFP_ZERO);
+		if (!zdev->cache_page) {
+			ret = -ENOMEM;
+			goto err_put;
+		}
+		zdev->cache = page_address(zdev->cache_page);
 	}
 
 	if ((ret = of_address_to_resource(np, 0, &res))) {
 		dev_err(dev, "probe: of_address_to_resource: %d\n", ret);
-		return ret;
+		goto err_put;
 	}
 
-	io_base = ioremap(res.start, resource_size(&res));
+	zdev->io_base = devm_ioremap(dev, res.start, resource_size(&res));
+	if (!zdev->io_base) {
+		ret = -ENOMEM;
+		goto err_put;
+	}
 
-	majorNumber = register_chrdev(0, DEVICE_NAME, &fops);
-	if (majorNumber < 0){
-		return majorNumber;
+	zdev->id = ida_alloc_max(&zzz_ida, MAX_DEVICES - 1, GFP_KERNEL);
+	if (zdev->id < 0) {
+		ret = zdev->id;
+		goto err_put;
 	}
 
-	zzzClass = class_create(THIS_MODULE, CLASS_NAME);
-	if (IS_ERR(zzzClass)){
-		unregister_chrdev(majorNumber, DEVICE_NAME);
-		return PTR_ERR(zzzClass);
+	zdev->irq_num = irq_of_parse_and_map(np, 0);
+
+	dev_info(dev, "probe: irq_num=%d id=%d\n", zdev->irq_num, zdev->id);
+
+	if ((ret = request_threaded_irq(zdev->irq_num, zzz_irq_handler, zzz_irq_thread, IRQF_TRIGGER_RISING, DEVICE_NAME, zdev))) {
+		dev_err(dev, "probe: request_threaded_irq: %d\n", ret);
+		goto err_ida;
 	}
 
-	zzzDevice = device_create(zzzClass, NULL, MKDEV(majorNumber, 0), NULL, DEVICE_NAME);
-	if (IS_ERR(zzzDevice)){
-		class_destroy(zzzClass);
-		unregister_chrdev(majorNumber, DEVICE_NAME);
-		return PTR_ERR(zzzDevice);
+	/* The first instance keeps the name it always had */
+	zdev->chr_dev.devt = MKDEV(majorNumber, zdev->id);
+	if (zdev->id == 0)
+		ret = dev_set_name(&zdev->chr_dev, DEVICE_NAME);
+	else
+		ret = dev_set_name(&zdev->chr_dev, DEVICE_NAME "%d", zdev->id);
+	if (ret)
+		goto err_irq;
+
+	cdev_init(&zdev->cdev, &fops);
+	zdev->cdev.owner = THIS_MODULE;
+	if ((ret = cdev_device_add(&zdev->cdev, &zdev->chr_dev)))
+		goto err_irq;
+
+	platform_set_drvdata(pdev, zdev);
+
+	zzz_debugfs_init(zdev);
+
+	if (cache && prefetch) {
+		mutex_lock(&zdev->cache_lock);
+		zzz_cache_fill_start(zdev);
+		mutex_unlock(&zdev->cache_lock);
 	}
 
 	return 0;
+
+err_irq:
+	free_irq(zdev->irq_num, zdev);
+err_ida:
+	irq_dispose_mapping(zdev->irq_num);
+	ida_free(&zzz_ida, zdev->id);
+err_put:
+	put_device(&zdev->chr_dev);
+	return ret;
 }
 
 static int __zzz_driver_remove(struct platform_device *pdev)
 {
-	device_destroy(zzzClass, MKDEV(majorNumber, 0));
-	class_destroy(zzzClass);
-	unregister_chrdev(majorNumber, DEVICE_NAME);
+	struct zzz_dev *zdev = platform_get_drvdata(pdev);
+
+	debugfs_remove_recursive(zdev->debugfs);
+
+	/* No new opens, the ones still open get ENODEV once shut down below */
+	cdev_device_del(&zdev->cdev, &zdev->chr_dev);
+
+	/* Don't lose what has been written */
+	cancel_delayed_work_sync(&zdev->wb_work);
+	mutex_lock(&zdev->cache_lock);
+	zzz_cache_flush(zdev);
+	if (zdev->wb_err)
+		dev_err(zdev->dev, "remove: write-back failed: %d\n", zdev->wb_err);
+
+	mutex_lock(&zdev->lock);
+	zzz_shutdown(zdev);
+	mutex_unlock(&zdev->lock);
 
-	free_irq(irq_num, &pdev->dev);
-	irq_dispose_mapping(irq_num);
+	/* A fill never collected, failed by the shutdown if it was still queued */
+	kfree(zdev->fill_req);
+	zdev->fill_req = NULL;
+	mutex_unlock(&zdev->cache_lock);
+
+	free_irq(zdev->irq_num, zdev);
+	irq_dispose_mapping(zdev->irq_num);
+
+	ida_free(&zzz_ida, zdev->id);
+
+	/* Freed right away, or when the last open file is closed */
+	put_device(&zdev->chr_dev);
 
 	return 0;
 }
 
 static int dev_open(struct inode *inodep, struct file *filep)
 {
+	struct zzz_file *zf;
+
+	zf = kzalloc(sizeof(*zf), GFP_KERNEL);
+	if (!zf)
+		return -ENOMEM;
+
+	zf->zdev = container_of(inodep->i_cdev, struct zzz_dev, cdev);
+	if (READ_ONCE(zf->zdev->removed)) {
+		kfree(zf);
+		return -ENODEV;
+	}
+	mutex_init(&zf->mutex);
+	filep->private_data = zf;
+
 	return 0;
 }
 
+/* Queue a read of the rest of the device from offset unless one is pending, called with file mutex held */
+static int zzz_read_submit(struct zzz_file *zf, size_t len, loff_t offset)
+{
+	if (zf->rd_req)
+		return 0;
+
+	zf->rd_req = zzz_req_alloc(false, offset, min(len, (size_t)(MEM_SIZE - offset)));
+	if (!zf->rd_req)
+		return -ENOMEM;
+
+	zzz_submit(zf->zdev, zf->rd_req);
+
+	return 0;
+}
+
+/*
+ * A read that does not complete (O_NONBLOCK or a signal) stays queued and its
+ * data is returned by the next read on the file.
+ */
 static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset)
 {
-	DEFINE_WAIT(wait);
+	struct zzz_file *zf = filep->private_data;
+	struct zzz_req *req;
+	ssize_t ret;
 
-	len = min(len, (size_t)(MEM_SIZE - *offset));
-	read_len = len;
-	read_idx = 0;
+	if (cache)
+		return zzz_cache_read(zf->zdev, filep->f_flags & O_NONBLOCK, buffer, len, offset);
+
+	mutex_lock(&zf->mutex);
 
-	/* Pay special attention to the order in which these steps are performed!!! */
-	{
-		prepare_to_wait(&wq, &wait, TASK_INTERRUPTIBLE);
-		/* Address device for write mode */
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 0 << 0);
-		state = S_READ_1;
-		schedule();
-		finish_wait(&wq, &wait);
+	if (!zf->rd_req && (*offset >= MEM_SIZE || len == 0)) {
+		ret = 0;
+		goto out;
 	}
 
-	len = len - copy_to_user(buffer, read_message, len);
+	if ((ret = zzz_read_submit(zf, len, *offset)))
+		goto out;
 
-	*offset += len;
+	req = zf->rd_req;
+	if ((ret = zzz_req_wait(zf->zdev, req, filep->f_flags & O_NONBLOCK)))
+		goto out;
 
-	return len;
+	zf->rd_req = NULL;
+
+	if (req->err) {
+		ret = req->err;
+	}
+	else {
+		len = min(len, (size_t)req->len);
+		len = len - copy_to_user(buffer, req->data, len);
+		*offset = req->base + len;
+		ret = len;
+		/* From submission, a nonblocking read is submitted by an earlier call */
+		zzz_read_lat_add(zf->zdev, req->submitted);
+	}
+	kfree(req);
+
+out:
+	mutex_unlock(&zf->mutex);
+
+	return ret;
 }
 
+/*
+ * With O_NONBLOCK the write is queued and the call returns right away, it
+ * fails with EAGAIN while the previous one is still in flight. Errors of a
+ * queued write are returned by the next write on the file.
+ */
 static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset)
 {
-	DEFINE_WAIT(wait);
+	struct zzz_file *zf = filep->private_data;
+	bool nonblock = filep->f_flags & O_NONBLOCK;
+	struct zzz_req *req;
+	ssize_t ret;
+
+	if (cache)
+		return zzz_cache_write(zf->zdev, nonblock, buffer, len, offset);
+
+	mutex_lock(&zf->mutex);
+
+	if ((req = zf->wr_req)) {
+		/* Previous write still around */
+		if ((ret = zzz_req_wait(zf->zdev, req, nonblock)))
+			goto out;
+		zf->wr_req = NULL;
+		ret = req->err;
+		kfree(req);
+		if (ret)
+			goto out;
+	}
+
+	if (*offset >= MEM_SIZE || len == 0) {
+		ret = 0;
+		goto out;
+	}
 
 	len = min(len, (size_t)(MEM_SIZE - *offset));
-	len = len - copy_from_user(write_message, buffer, len);
-	write_len = len;
-	write_idx = 0;
+	req = zzz_req_alloc(true, *offset, len);
+	if (!req) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	if (copy_from_user(req->data, buffer, len)) {
+		kfree(req);
+		ret = -EFAULT;
+		goto out;
+	}
 
-	/* Pay special attention to the order in which these steps are performed!!! */
-	{
-		prepare_to_wait(&wq, &wait, TASK_INTERRUPTIBLE);
-		/* I2C address device for write mode */
-		state = S_WRITE_1;
-		axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | I2C_ADDR << 1 | 0 << 0);
-		schedule();
-		finish_wait(&wq, &wait);
+	zf->wr_req = req;
+	zzz_submit(zf->zdev, req);
+
+	/* Interrupted while blocked the write still completes in the background */
+	if (nonblock || zzz_req_wait(zf->zdev, req, false)) {
+		*offset += len;
+		ret = len;
+		goto out;
 	}
 
-	*offset += len;
+	zf->wr_req = NULL;
+	ret = req->err ? req->err : len;
+	if (!req->err)
+		*offset += len;
+	kfree(req);
 
-	return len;
+out:
+	mutex_unlock(&zf->mutex);
+
+	return ret;
+}
+
+/*
+ * Readable once a read of the rest of the device from the file position is
+ * done, or with the cache once it has been filled
+ */
+static __poll_t dev_poll(struct file *filep, poll_table *wait)
+{
+	struct zzz_file *zf = filep->private_data;
+	struct zzz_dev *zdev = zf->zdev;
+	__poll_t mask = 0;
+
+	poll_wait(filep, &zdev->wq, wait);
+
+	if (READ_ONCE(zdev->removed))
+		return EPOLLERR | EPOLLHUP;
+
+	if (cache) {
+		mutex_lock(&zdev->cache_lock);
+		if (zzz_cache_fill_start(zdev))
+			mask |= EPOLLERR;
+		if (zdev->cache_valid || (zdev->fill_req && completion_done(&zdev->fill_req->done)))
+			mask |= EPOLLIN | EPOLLRDNORM | EPOLLOUT | EPOLLWRNORM;
+		mutex_unlock(&zdev->cache_lock);
+		return mask;
+	}
+
+	mutex_lock(&zf->mutex);
+
+	if (filep->f_pos < MEM_SIZE && zzz_read_submit(zf, MEM_SIZE, filep->f_pos))
+		mask |= EPOLLERR;
+	if (!zf->rd_req || completion_done(&zf->rd_req->done))
+		mask |= EPOLLIN | EPOLLRDNORM;
+	if (!zf->wr_req || completion_done(&zf->wr_req->done))
+		mask |= EPOLLOUT | EPOLLWRNORM;
+
+	mutex_unlock(&zf->mutex);
+
+	return mask;
+}
+
+/* Write back dirty pages, or wait for a queued uncached write */
+static int dev_fsync(struct file *filep, loff_t start, loff_t end, int datasync)
+{
+	struct zzz_file *zf = filep->private_data;
+	struct zzz_dev *zdev = zf->zdev;
+	struct zzz_req *req;
+	int ret = 0;
+
+	if (cache) {
+		cancel_delayed_work_sync(&zdev->wb_work);
+		mutex_lock(&zdev->cache_lock);
+		if (zdev->removed) {
+			ret = -ENODEV;
+		}
+		else {
+			zzz_cache_flush(zdev);
+			ret = zdev->wb_err;
+			zdev->wb_err = 0;
+		}
+		mutex_unlock(&zdev->cache_lock);
+		return ret;
+	}
+
+	mutex_lock(&zf->mutex);
+	if ((req = zf->wr_req)) {
+		if (!(ret = zzz_req_wait(zdev, req, false))) {
+			zf->wr_req = NULL;
+			ret = req->err;
+			kfree(req);
+		}
+	}
+	mutex_unlock(&zf->mutex);
+
+	return ret;
+}
+
+/* Read-only mapping of the cache, the page stays around while mapped even after remove */
+static int dev_mmap(struct file *filep, struct vm_area_struct *vma)
+{
+	struct zzz_file *zf = filep->private_data;
+	struct zzz_dev *zdev = zf->zdev;
+	int ret;
+
+	if (!cache)
+		return -ENODEV;
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > PAGE_SIZE)
+		return -EINVAL;
+
+	if ((ret = zzz_cache_lock(zdev, false)))
+		return ret;
+	mutex_unlock(&zdev->cache_lock);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+	vm_flags_clear(vma, VM_MAYWRITE);
+#else
+	vma->vm_flags &= ~VM_MAYWRITE;
+#endif
+
+	return vm_insert_page(vma, vma->vm_start, zdev->cache_page);
 }
 
 static int dev_release(struct inode *inodep, struct file *filep)
 {
+	struct zzz_file *zf = filep->private_data;
+
+	zzz_abandon(zf->zdev, zf->rd_req);
+	zzz_abandon(zf->zdev, zf->wr_req);
+	kfree(zf);
+
 	return 0;
 }
 
@@ -315,4 +1195,40 @@ static struct platform_driver __zzz_driver = {
 	.remove = __zzz_driver_remove
 };
 
-module_platform_driver(__zzz_driver);
+static int __init zzz_init(void)
+{
+	dev_t devt;
+	int ret;
+
+	if ((ret = alloc_chrdev_region(&devt, 0, MAX_DEVICES, DEVICE_NAME)))
+		return ret;
+	majorNumber = MAJOR(devt);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+	zzzClass = class_create(CLASS_NAME);
+#else
+	zzzClass = class_create(THIS_MODULE, CLASS_NAME);
+#endif
+	if (IS_ERR(zzzClass)){
+		unregister_chrdev_region(MKDEV(majorNumber, 0), MAX_DEVICES);
+		return PTR_ERR(zzzClass);
+	}
+
+	if ((ret = platform_driver_register(&__zzz_driver))) {
+		class_destroy(zzzClass);
+		unregister_chrdev_region(MKDEV(majorNumber, 0), MAX_DEVICES);
+		return ret;
+	}
+
+	return 0;
+}
+
+static void __exit zzz_exit(void)
+{
+	platform_driver_unregister(&__zzz_driver);
+	class_destroy(zzzClass);
+	unregister_chrdev_region(MKDEV(majorNumber, 0), MAX_DEVICES);
+}
+
+module_init(zzz_init);
+module_exit(zzz_exit);
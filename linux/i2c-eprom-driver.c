@@ -6,22 +6,137 @@
 #include <linux/platform_device.h>
 #include <linux/of_irq.h>
 #include <linux/device.h>
+#include <linux/debugfs.h>
 #include <linux/fs.h>
+#include <linux/seq_file.h>
 #include <linux/uaccess.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/moduleparam.h>
+#include <linux/mutex.h>
+
+#include "i2c-eprom-stats.h"
 
 #define DEVICE_NAME "zzz-i2c-eprom"
 #define CLASS_NAME "zzz"
 
 #define MEM_SIZE 16
+#define EPROM_PAGE_SIZE 8
 #define I2C_ADDR 0x10
 
-#define assert(x)
-
 MODULE_LICENSE("GPL");
 MODULE_AUTHOR("Markus Lavin (https://www.zzzconsulting.se)");
 MODULE_DESCRIPTION("Device driver for the I2C EPROM tutorial posts from https://www.zzzconsulting.se/");
 MODULE_VERSION("0.1");
 
+/* Per operation statistics in /sys/kernel/debug/zzz-i2c-eprom/ */
+static struct {
+	struct lat_hist read_lat;
+	struct lat_hist write_lat;
+	u64 bytes_read;
+	u64 bytes_written;
+	u64 ack_errors; /* Missing ACK or write cycle ACK poll timeout */
+} op_stats;
+
+static struct dentry *zzz_debugfs;
+
+/*
+ * Waiting for the interface is a hybrid of sleeping and polling. The expected
+ * transfer time is computed from the AXI clock and the SCL divider, most of it
+ * is slept away on a hrtimer and the remainder is spent spinning on the status
+ * register. Setting adaptive=0 gives back the plain schedule() polling loop.
+ */
+static bool adaptive = true;
+module_param(adaptive, bool, 0644);
+MODULE_PARM_DESC(adaptive, "Sleep for the expected byte time before polling (default: 1)");
+
+/* The wait for idle timeout is derived from these two, reprogrammed when either changes */
+static void i2c_wait_timeout_update(void);
+
+static int wait_timeout_param_set_uint(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_uint(val, kp);
+
+	if (!ret)
+		i2c_wait_timeout_update();
+	return ret;
+}
+
+static int wait_timeout_param_set_ulong(const char *val, const struct kernel_param *kp)
+{
+	int ret = param_set_ulong(val, kp);
+
+	if (!ret)
+		i2c_wait_timeout_update();
+	return ret;
+}
+
+static const struct kernel_param_ops wait_timeout_uint_ops = {
+	.set = wait_timeout_param_set_uint,
+	.get = param_get_uint,
+};
+
+static const struct kernel_param_ops wait_timeout_ulong_ops = {
+	.set = wait_timeout_param_set_ulong,
+	.get = param_get_ulong,
+};
+
+static ulong axi_clk_hz = 100000000;
+module_param_cb(axi_clk_hz, &wait_timeout_ulong_ops, &axi_clk_hz, 0644);
+MODULE_PARM_DESC(axi_clk_hz, "AXI clock frequency of the controller in Hz (default: 100000000)");
+
+static uint scl_div_log2 = 2;
+module_param(scl_div_log2, uint, 0644);
+MODULE_PARM_DESC(scl_div_log2, "SCL divider of the controller, C_CLK_DIVIDER_LOG2 (default: 2)");
+
+static uint spin_ns = 2000;
+module_param_cb(spin_ns, &wait_timeout_uint_ops, &spin_ns, 0644);
+MODULE_PARM_DESC(spin_ns, "Time spent polling at the end of the expected byte time in ns (default: 2000)");
+
+static uint slack_ns = 1000;
+module_param(slack_ns, uint, 0644);
+MODULE_PARM_DESC(slack_ns, "Allowed timer slack when sleeping in ns (default: 1000)");
+
+static uint timeout_ms = 1000;
+module_param(timeout_ms, uint, 0644);
+MODULE_PARM_DESC(timeout_ms, "Time before a wait for the interface is given up and the bus recovered in ms (default: 1000)");
+
+/*
+ * Poll the wait for idle register rather than the status register. The
+ * controller does not answer the read until it is idle, or until its wait
+ * timeout expires, which is kept at spin_ns. One read then does what the
+ * spin loop did.
+ */
+static bool wait_reg = true;
+module_param(wait_reg, bool, 0644);
+MODULE_PARM_DESC(wait_reg, "Let the controller hold back the status read until idle (default: 1)");
+
+/*
+ * Reads are served from a copy of the EPROM filled on first use, writes go
+ * straight to the device and update the copy.
+ */
+static bool cache = true;
+module_param(cache, bool, 0644);
+MODULE_PARM_DESC(cache, "Serve reads from an in-kernel copy of the EPROM (default: 1)");
+
+static char cache_data[MEM_SIZE];
+static bool cache_valid;
+
+/* One read or write at a time, also protects wait_stats */
+static DEFINE_MUTEX(op_lock);
+
+static struct {
+	u64 waits;      /* Calls to i2c_wait_idle */
+	u64 sleeps;     /* hrtimer sleeps */
+	u64 polls;      /* Status register reads */
+	u64 oversleeps; /* Already idle at the first poll after sleeping */
+	u64 overruns;   /* Still busy when done spinning */
+	u64 timeouts;   /* Given up after timeout_ms */
+	u64 total_ns;
+	u64 max_ns;
+} wait_stats;
+
 static int majorNumber;
 
 static struct class *zzzClass  = NULL;
@@ -54,6 +169,12 @@ static uint32_t axi_master_read(uint32_t address)
 
 static const uint32_t i2c_ctrl_addr = 0x00c;
 static const uint32_t i2c_status_addr = 0x010;
+static const uint32_t i2c_wait_idle_addr = 0x014;
+static const uint32_t i2c_wait_timeout_addr = 0x018;
+static const uint32_t i2c_abort_addr = 0x01c;
+static const uint32_t i2c_seq_cmd_addr = 0x024;
+static const uint32_t i2c_seq_data_addr = 0x028;
+static const uint32_t i2c_seq_status_addr = 0x02c;
 
 static const uint32_t i2c_ctrl_we_bit = 1 << 10;
 static const uint32_t i2c_ctrl_start_bit = 1 << 9;
@@ -62,76 +183,278 @@ static const uint32_t i2c_ctrl_stop_bit = 1 << 8;
 static const uint32_t i2c_status_busy_bit = 1 << 9;
 static const uint32_t i2c_status_ack_bit = 1 << 8;
 
-static void i2c_mem_write(uint8_t i2c_addr, uint8_t mem_addr, uint8_t mem_data)
+static const uint32_t i2c_seq_cmd_poll_bit = 1 << 25;
+static const uint32_t i2c_seq_cmd_page_write_bit = 1 << 24;
+
+static const uint32_t i2c_seq_status_poll_err_bit = 1 << 2;
+static const uint32_t i2c_seq_status_nack_err_bit = 1 << 1;
+static const uint32_t i2c_seq_status_rej_err_bit = 1 << 5;
+
+/* Clock cycles the wait for idle register holds a read back, 0 would be forever */
+static void i2c_wait_timeout_update(void)
 {
-	uint32_t status;
-	/* Make sure interface is not busy */
-	while (axi_master_read(i2c_status_addr) & i2c_status_busy_bit) schedule();
+	/* Parameters given at load time are applied by zzz_init */
+	if (!io_base)
+		return;
+
+	mutex_lock(&op_lock);
+	axi_master_write(i2c_wait_timeout_addr,
+	                 max_t(u64, div64_ul((u64)spin_ns * axi_clk_hz, NSEC_PER_SEC), 1));
+	mutex_unlock(&op_lock);
+}
 
-	/* Address for write mode */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 0 << 0);
+/* Time to shift nbytes on the bus, four SCL phases per bit and nine bits per byte */
+static ktime_t i2c_byte_time(unsigned int nbytes)
+{
+	u64 cycles = ((u64)nbytes * 9 * 4) << scl_div_log2;
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit) schedule();
-	assert(status & i2c_status_ack_bit && "I2C address ACK");
+	return ns_to_ktime(div64_ul(cycles * NSEC_PER_SEC, max(axi_clk_hz, 1UL)));
+}
 
-	/* Memory address */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
+/*
+ * Wait until the interface is idle, nbytes is the expected transfer length.
+ * Returns 0 with the status in *status, or -ETIMEDOUT after timeout_ms in
+ * which case the controller is told to abort and recover the bus. Called
+ * with op_lock held.
+ */
+static int i2c_wait_idle(unsigned int nbytes, uint32_t *status)
+{
+	const uint32_t status_addr = wait_reg ? i2c_wait_idle_addr : i2c_status_addr;
+	ktime_t start = ktime_get();
+	ktime_t timeout = ktime_add_ms(start, timeout_ms);
+	ktime_t t, deadline;
+	bool first;
+	int ret = 0;
+	u64 ns;
+
+	wait_stats.waits++;
+
+	if (!adaptive) {
+		while ((*status = axi_master_read(status_addr)) & i2c_status_busy_bit) {
+			wait_stats.polls++;
+			if (ktime_after(ktime_get(), timeout))
+				goto timeout;
+			schedule();
+		}
+		wait_stats.polls++;
+		goto done;
+	}
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit) schedule();
-	assert(status & i2c_status_ack_bit && "MEM address ACK");
+	t = i2c_byte_time(nbytes);
+	for (;;) {
+		/* Sleep through the bulk of the expected time */
+		first = false;
+		if (ktime_to_ns(t) > spin_ns) {
+			t = ktime_sub_ns(t, spin_ns);
+			set_current_state(TASK_UNINTERRUPTIBLE);
+			schedule_hrtimeout_range(&t, slack_ns, HRTIMER_MODE_REL);
+			wait_stats.sleeps++;
+			first = true;
+		}
+
+		/* Then spin for the remainder */
+		deadline = ktime_add_ns(ktime_get(), spin_ns);
+		do {
+			wait_stats.polls++;
+			*status = axi_master_read(status_addr);
+			if (!(*status & i2c_status_busy_bit)) {
+				if (first)
+					wait_stats.oversleeps++;
+				goto done;
+			}
+			first = false;
+			cpu_relax();
+		} while (ktime_before(ktime_get(), deadline));
+
+		/* Longer than expected (start/stop, clock stretching, write cycle), go on a byte at a time */
+		wait_stats.overruns++;
+		if (ktime_after(ktime_get(), timeout))
+			goto timeout;
+		t = i2c_byte_time(1);
+	}
 
-	/* Memory data */
-	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_stop_bit | mem_data);
+timeout:
+	/* Stuck, e.g. a slave holding SCL low, the next wait picks up after the recovery */
+	pr_err(DEVICE_NAME ": timed out waiting for the interface, recovering bus\n");
+	wait_stats.timeouts++;
+	axi_master_write(i2c_abort_addr, 1);
+	ret = -ETIMEDOUT;
 
-	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit) schedule();
-	assert(status & i2c_status_ack_bit && "MEM write ACK");
+done:
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	wait_stats.total_ns += ns;
+	wait_stats.max_ns = max(wait_stats.max_ns, ns);
+
+	return ret;
+}
+
+/* Failed checks are counted, and fail the operation with err */
+static int i2c_ack_error(int err)
+{
+	op_stats.ack_errors++;
+
+	return err;
 }
 
-static uint8_t i2c_mem_read(uint8_t i2c_addr, uint8_t mem_addr)
+static int i2c_mem_write_page(uint8_t i2c_addr, uint8_t mem_addr, const uint8_t *mem_data, int len)
 {
 	uint32_t status;
+	int ret;
+	int i;
 	/* Make sure interface is not busy */
-	while (axi_master_read(i2c_status_addr) & i2c_status_busy_bit) schedule();
+	if ((ret = i2c_wait_idle(0, &status)))
+		return ret;
+
+	/* Fill page buffer */
+	for (i = 0; i < len; ++i)
+		axi_master_write(i2c_seq_data_addr, mem_data[i]);
+
+	/* Page write followed by ACK polling until the write cycle is over */
+	axi_master_write(i2c_seq_cmd_addr, i2c_seq_cmd_poll_bit | i2c_seq_cmd_page_write_bit | mem_addr << 8 | i2c_addr);
+
+	/* Wait until complete, device and memory address plus data */
+	if ((ret = i2c_wait_idle(len + 2, &status)))
+		return ret;
+	status = axi_master_read(i2c_seq_status_addr);
+	if (status & i2c_seq_status_rej_err_bit)
+		return i2c_ack_error(-EBUSY);
+	if (status & i2c_seq_status_nack_err_bit)
+		return i2c_ack_error(-EIO);
+	if (status & i2c_seq_status_poll_err_bit)
+		return i2c_ack_error(-ETIMEDOUT);
+
+	return 0;
+}
+
+/* The transfer is left open on a missing ACK, abort it to end it and recover the bus */
+static int i2c_nack(void)
+{
+	axi_master_write(i2c_abort_addr, 1);
+
+	return i2c_ack_error(-EIO);
+}
+
+/* Returns the byte read or a negative error */
+static int i2c_mem_read(uint8_t i2c_addr, uint8_t mem_addr)
+{
+	uint32_t status;
+	int ret;
+	/* Make sure interface is not busy */
+	if ((ret = i2c_wait_idle(0, &status)))
+		return ret;
 
 	/* Address for write mode */
 	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 0 << 0);
 
 	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit) schedule();
-	assert(status & i2c_status_ack_bit && "I2C (write) address ACK");
+	if ((ret = i2c_wait_idle(1, &status)))
+		return ret;
+	if (!(status & i2c_status_ack_bit))
+		return i2c_nack();
 
 	/* Memory address */
 	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | mem_addr);
 
 	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit) schedule();
-	assert(status & i2c_status_ack_bit && "MEM address ACK");
+	if ((ret = i2c_wait_idle(1, &status)))
+		return ret;
+	if (!(status & i2c_status_ack_bit))
+		return i2c_nack();
 
 	/* Address for read mode */
 	axi_master_write(i2c_ctrl_addr, i2c_ctrl_we_bit | i2c_ctrl_start_bit | i2c_addr << 1 | 1 << 0);
 
 	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit) schedule();
-	assert(status & i2c_status_ack_bit && "I2C (read) address ACK");
+	if ((ret = i2c_wait_idle(1, &status)))
+		return ret;
+	if (!(status & i2c_status_ack_bit))
+		return i2c_nack();
 
 	/* Memory data */
 	axi_master_write(i2c_ctrl_addr, i2c_ctrl_stop_bit);
 
 	/* Wait until complete */
-	while ((status = axi_master_read(i2c_status_addr)) & i2c_status_busy_bit) schedule();
-	assert(status & i2c_status_ack_bit && "MEM read ACK");
+	if ((ret = i2c_wait_idle(1, &status)))
+		return ret;
+	if (!(status & i2c_status_ack_bit))
+		return i2c_nack();
 
 	return status & 0xff;
 }
 
 
+#define WAIT_STAT_ATTR(_name)							\
+static ssize_t _name##_show(struct device *dev, struct device_attribute *attr, char *buf) \
+{										\
+	u64 val;								\
+										\
+	mutex_lock(&op_lock);							\
+	val = wait_stats._name;							\
+	mutex_unlock(&op_lock);							\
+	return sprintf(buf, "%llu\n", val);					\
+}										\
+static DEVICE_ATTR_RO(_name)
+
+WAIT_STAT_ATTR(waits);
+WAIT_STAT_ATTR(sleeps);
+WAIT_STAT_ATTR(polls);
+WAIT_STAT_ATTR(oversleeps);
+WAIT_STAT_ATTR(overruns);
+WAIT_STAT_ATTR(total_ns);
+WAIT_STAT_ATTR(max_ns);
+WAIT_STAT_ATTR(timeouts);
+
+static ssize_t reset_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+	mutex_lock(&op_lock);
+	memset(&wait_stats, 0, sizeof(wait_stats));
+	mutex_unlock(&op_lock);
+	return count;
+}
+static DEVICE_ATTR_WO(reset);
+
+static struct attribute *wait_stats_attrs[] = {
+	&dev_attr_waits.attr,
+	&dev_attr_sleeps.attr,
+	&dev_attr_polls.attr,
+	&dev_attr_oversleeps.attr,
+	&dev_attr_overruns.attr,
+	&dev_attr_total_ns.attr,
+	&dev_attr_max_ns.attr,
+	&dev_attr_timeouts.attr,
+	&dev_attr_reset.attr,
+	NULL,
+};
+
+/* Busy-wait statistics in /sys/class/zzz/zzz-i2c-eprom/wait_stats/ */
+static const struct attribute_group wait_stats_group = {
+	.name = "wait_stats",
+	.attrs = wait_stats_attrs,
+};
+
+static const struct attribute_group *zzz_groups[] = {
+	&wait_stats_group,
+	NULL,
+};
+
+static void zzz_debugfs_init(void)
+{
+	struct dentry *d = debugfs_create_dir(DEVICE_NAME, NULL);
+
+	zzz_debugfs = d;
+	debugfs_create_file("read_latency", 0444, d, &op_stats.read_lat, &lat_hist_fops);
+	debugfs_create_file("write_latency", 0444, d, &op_stats.write_lat, &lat_hist_fops);
+	debugfs_create_u64("bytes_read", 0444, d, &op_stats.bytes_read);
+	debugfs_create_u64("bytes_written", 0444, d, &op_stats.bytes_written);
+	debugfs_create_u64("ack_errors", 0444, d, &op_stats.ack_errors);
+}
+
 static int __init zzz_init(void)
 {
 	io_base = ioremap(0x1e00b000, SZ_4K);
 
+	i2c_wait_timeout_update();
+
 	majorNumber = register_chrdev(0, DEVICE_NAME, &fops);
 	if (majorNumber < 0){
 		return majorNumber;
@@ -143,18 +466,21 @@ static int __init zzz_init(void)
 		return PTR_ERR(zzzClass);
 	}
 
-	zzzDevice = device_create(zzzClass, NULL, MKDEV(majorNumber, 0), NULL, DEVICE_NAME);
+	zzzDevice = device_create_with_groups(zzzClass, NULL, MKDEV(majorNumber, 0), NULL, zzz_groups, DEVICE_NAME);
 	if (IS_ERR(zzzDevice)){
 		class_destroy(zzzClass);
 		unregister_chrdev(majorNumber, DEVICE_NAME);
 		return PTR_ERR(zzzDevice);
 	}
 
+	zzz_debugfs_init();
+
 	return 0;
 }
 
 static void __exit zzz_exit(void)
 {
+	debugfs_remove_recursive(zzz_debugfs);
 	device_destroy(zzzClass, MKDEV(majorNumber, 0));
 	class_unregister(zzzClass);
 	class_destroy(zzzClass);
@@ -169,34 +495,88 @@ static int dev_open(struct inode *inodep, struct file *filep)
 static ssize_t dev_read(struct file *filep, char *buffer, size_t len, loff_t *offset)
 {
 	char message[MEM_SIZE];
+	ktime_t start = ktime_get();
+	ssize_t ret;
 	int i;
 
+	if (*offset >= MEM_SIZE)
+		return 0;
+
 	len = min(len, (size_t)(MEM_SIZE - *offset));
 
-	for (i = 0; i < len; ++i)
-		message[i] = i2c_mem_read(I2C_ADDR, *offset + i);
+	mutex_lock(&op_lock);
+
+	if (cache) {
+		if (!cache_valid) {
+			for (i = 0; i < MEM_SIZE; ++i) {
+				if ((ret = i2c_mem_read(I2C_ADDR, i)) < 0)
+					goto out;
+				cache_data[i] = ret;
+			}
+			cache_valid = true;
+		}
+		memcpy(message, cache_data + *offset, len);
+	}
+	else {
+		for (i = 0; i < len; ++i) {
+			if ((ret = i2c_mem_read(I2C_ADDR, *offset + i)) < 0)
+				goto out;
+			message[i] = ret;
+		}
+	}
 
 	len = len - copy_to_user(buffer, message, len);
 
+	op_stats.bytes_read += len;
+	lat_hist_add(&op_stats.read_lat, start);
+
 	*offset += len;
+	ret = len;
 
-	return len;
+out:
+	mutex_unlock(&op_lock);
+
+	return ret;
 }
 
 static ssize_t dev_write(struct file *filep, const char *buffer, size_t len, loff_t *offset)
 {
 	char message[MEM_SIZE];
-	int i;
+	ktime_t start = ktime_get();
+	ssize_t ret;
+	size_t i, n;
+
+	if (*offset >= MEM_SIZE)
+		return 0;
 
 	len = min(len, (size_t)(MEM_SIZE - *offset));
 	len = len - copy_from_user(message, buffer, len);
 
-	for (i = 0; i < len; ++i)
-		i2c_mem_write(I2C_ADDR, *offset + i, message[i]);
+	mutex_lock(&op_lock);
+
+	/* One page write per page touched, never crossing a page boundary */
+	for (i = 0; i < len; i += n) {
+		n = min((size_t)(EPROM_PAGE_SIZE - (*offset + i) % EPROM_PAGE_SIZE), len - i);
+		if ((ret = i2c_mem_write_page(I2C_ADDR, *offset + i, (uint8_t *)message + i, n))) {
+			/* Part of it may have made it, the copy can no longer be trusted */
+			cache_valid = false;
+			goto out;
+		}
+	}
+
+	/* Write-through, also keeps the copy right while the cache is disabled */
+	memcpy(cache_data + *offset, message, len);
+
+	op_stats.bytes_written += len;
+	lat_hist_add(&op_stats.write_lat, start);
 
 	*offset += len;
+	ret = len;
+
+out:
+	mutex_unlock(&op_lock);
 
-	return len;
+	return ret;
 }
 
 static int dev_release(struct inode *inodep, struct file *filep)
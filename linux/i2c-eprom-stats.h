@@ -0,0 +1,43 @@
+/*
+ * Latency histograms of the EPROM drivers, shown below
+ * /sys/kernel/debug/ by each of them.
+ */
+#ifndef _I2C_EPROM_STATS_H
+#define _I2C_EPROM_STATS_H
+
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/seq_file.h>
+
+#define LAT_BUCKETS 16
+
+/* Bucket n > 0 counts latencies in [2^(n-1), 2^n) us, the last one everything above */
+struct lat_hist {
+	u64 count[LAT_BUCKETS];
+};
+
+static inline void lat_hist_add(struct lat_hist *h, ktime_t start)
+{
+	u64 us = ktime_us_delta(ktime_get(), start);
+
+	h->count[min_t(int, fls64(us), LAT_BUCKETS - 1)]++;
+}
+
+static inline int lat_hist_show(struct seq_file *m, void *v)
+{
+	struct lat_hist *h = m->private;
+	int i;
+
+	for (i = 0; i < LAT_BUCKETS; i++) {
+		if (i == LAT_BUCKETS - 1)
+			seq_printf(m, "%6llu-       us: %llu\n", i ? 1ULL << (i - 1) : 0, h->count[i]);
+		else
+			seq_printf(m, "%6llu-%6llu us: %llu\n", i ? 1ULL << (i - 1) : 0, 1ULL << i, h->count[i]);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(lat_hist);
+
+#endif /* _I2C_EPROM_STATS_H */
@@ -0,0 +1,101 @@
+/*
+ * Tracepoints of the IRQ driven EPROM driver, found below
+ * /sys/kernel/tracing/events/zzz_i2c_eprom/ once the module is loaded.
+ *
+ * States are reported by their value in enum zzz_state.
+ */
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM zzz_i2c_eprom
+
+#if !defined(_I2C_EPROM_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _I2C_EPROM_TRACE_H
+
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(zzz_eprom_irq,
+	TP_PROTO(int id, int state, u32 status),
+	TP_ARGS(id, state, status),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(int, state)
+		__field(u32, status)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->state = state;
+		__entry->status = status;
+	),
+	TP_printk("dev=%d state=%d status=0x%03x", __entry->id, __entry->state, __entry->status)
+);
+
+TRACE_EVENT(zzz_eprom_state,
+	TP_PROTO(int id, int from, int to),
+	TP_ARGS(id, from, to),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(int, from)
+		__field(int, to)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->from = from;
+		__entry->to = to;
+	),
+	TP_printk("dev=%d %d -> %d", __entry->id, __entry->from, __entry->to)
+);
+
+TRACE_EVENT(zzz_eprom_nack,
+	TP_PROTO(int id, int state, u32 status),
+	TP_ARGS(id, state, status),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(int, state)
+		__field(u32, status)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->state = state;
+		__entry->status = status;
+	),
+	TP_printk("dev=%d state=%d status=0x%03x", __entry->id, __entry->state, __entry->status)
+);
+
+DECLARE_EVENT_CLASS(zzz_eprom_req,
+	TP_PROTO(int id, bool write, int base, int len, int err),
+	TP_ARGS(id, write, base, len, err),
+	TP_STRUCT__entry(
+		__field(int, id)
+		__field(bool, write)
+		__field(int, base)
+		__field(int, len)
+		__field(int, err)
+	),
+	TP_fast_assign(
+		__entry->id = id;
+		__entry->write = write;
+		__entry->base = base;
+		__entry->len = len;
+		__entry->err = err;
+	),
+	TP_printk("dev=%d %s addr=0x%02x len=%d err=%d", __entry->id,
+		  __entry->write ? "write" : "read", __entry->base, __entry->len, __entry->err)
+);
+
+/* Request taken off the queue and put on the bus */
+DEFINE_EVENT(zzz_eprom_req, zzz_eprom_req_start,
+	TP_PROTO(int id, bool write, int base, int len, int err),
+	TP_ARGS(id, write, base, len, err)
+);
+
+DEFINE_EVENT(zzz_eprom_req, zzz_eprom_req_done,
+	TP_PROTO(int id, bool write, int base, int len, int err),
+	TP_ARGS(id, write, base, len, err)
+);
+
+#endif /* _I2C_EPROM_TRACE_H */
+
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE i2c-eprom-trace
+#include <trace/define_trace.h>
@@ -0,0 +1,98 @@
+#include <linux/init.h>
+#include <linux/interrupt.h>
+#include <linux/irqdomain.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/platform_device.h>
+#include <linux/of_address.h>
+#include <linux/of_irq.h>
+#include <linux/device.h>
+#include <linux/slab.h>
+#include <linux/uio_driver.h>
+
+/*
+ * Hands the controller to userspace through UIO. The register window is map 0
+ * of /dev/uioN and a read() blocks until the next IRQ, see i2c_uio.c for the
+ * userspace side. The IRQ is edge triggered and acknowledged by userspace in
+ * the controller, so there is nothing to do here but count it.
+ */
+
+#define DEVICE_NAME "zzz-i2c-uio"
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("Markus Lavin (https://www.zzzconsulting.se)");
+MODULE_DESCRIPTION("UIO driver for the I2C controller tutorial posts from https://www.zzzconsulting.se/");
+MODULE_VERSION("0.1");
+
+static irqreturn_t zzz_uio_handler(int irq, struct uio_info *info)
+{
+	return IRQ_HANDLED;
+}
+
+static int __zzz_driver_probe(struct platform_device *pdev)
+{
+	struct device *dev = &pdev->dev;
+	struct device_node *np = dev->of_node;
+	struct uio_info *info;
+	struct resource res;
+	int ret;
+
+	info = devm_kzalloc(dev, sizeof(*info), GFP_KERNEL);
+	if (!info)
+		return -ENOMEM;
+
+	if ((ret = of_address_to_resource(np, 0, &res))) {
+		dev_err(dev, "probe: of_address_to_resource: %d\n", ret);
+		return ret;
+	}
+
+	info->name = DEVICE_NAME;
+	info->version = "0.1";
+	info->mem[0].name = "regs";
+	info->mem[0].addr = res.start;
+	info->mem[0].size = resource_size(&res);
+	info->mem[0].memtype = UIO_MEM_PHYS;
+
+	info->irq = irq_of_parse_and_map(np, 0);
+	info->irq_flags = IRQF_TRIGGER_RISING;
+	info->handler = zzz_uio_handler;
+
+	dev_info(dev, "probe: irq_num=%ld\n", info->irq);
+
+	if ((ret = uio_register_device(dev, info))) {
+		dev_err(dev, "probe: uio_register_device: %d\n", ret);
+		irq_dispose_mapping(info->irq);
+		return ret;
+	}
+
+	platform_set_drvdata(pdev, info);
+
+	return 0;
+}
+
+static int __zzz_driver_remove(struct platform_device *pdev)
+{
+	struct uio_info *info = platform_get_drvdata(pdev);
+
+	uio_unregister_device(info);
+	irq_dispose_mapping(info->irq);
+
+	return 0;
+}
+
+static const struct of_device_id __zzz_driver_id[] = {
+	{.compatible = "zzz-i2c-uio"},
+	{}
+};
+
+static struct platform_driver __zzz_driver = {
+	.driver = {
+		.name = DEVICE_NAME,
+		.owner = THIS_MODULE,
+		.of_match_table = of_match_ptr(__zzz_driver_id),
+	},
+	.probe = __zzz_driver_probe,
+	.remove = __zzz_driver_remove
+};
+
+module_platform_driver(__zzz_driver);
@@ -2,20 +2,42 @@
 #include "hw/sysbus.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
+#include "qemu/timer.h"
 
 #define TYPE_AXI_MASTER_CLIENT_DEVICE "axi_master_client_device"
 #define AXI_MASTER_CLIENT_DEVICE(obj) OBJECT_CHECK(AxiMasterClientDeviceState, (obj), TYPE_AXI_MASTER_CLIENT_DEVICE)
 
 #define SOCK_PATH "/tmp/axi_master_socket"
+#define SOCK_PATH_ENV "AXI_MASTER_SOCKET"
 
 #define D(x)
 
 struct axi_master_msg {
-	enum {MSG_CODE_WRITE_CMD = 1, MSG_CODE_WRITE_ACK = 2, MSG_CODE_READ_CMD = 3, MSG_CODE_READ_ACK = 4} code;
+	enum {MSG_CODE_WRITE_CMD = 1, MSG_CODE_WRITE_ACK = 2, MSG_CODE_READ_CMD = 3, MSG_CODE_READ_ACK = 4,
+	      MSG_CODE_STATS = 7} code;
 	uint32_t address;
 	uint32_t data;
 };
 
+/* Async socket, one per IRQ line change */
+struct axi_master_irq_msg {
+	uint32_t level;
+	uint32_t seq;
+	uint64_t sim_time;
+};
+
+/* Sent to the simulator on exit, for its cosimulation report */
+struct axi_master_client_stats {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t send_ns;       /* In send() of requests */
+	uint64_t recv_ns;       /* Waiting in recv() for the replies */
+	uint64_t irq_msgs;      /* IRQ messages received on the async socket */
+	uint64_t irq_raised;    /* Rising edges passed on to the guest */
+	uint64_t irq_lock_ns;   /* Waiting for the BQL to pass them on */
+	uint64_t wall_ns;       /* Connected */
+};
+
 typedef struct AxiMasterClientDeviceState {
 	SysBusDevice parent_obj;
 	MemoryRegion iomem;
@@ -23,8 +45,13 @@ typedef struct AxiMasterClientDeviceState {
 	int sock_sync_fd;
 	int sock_async_fd;
 	uint32_t base_address;
+	int64_t connect_ns;
+	struct axi_master_client_stats stats;
 } AxiMasterClientDeviceState;
 
+/* The device whose statistics go to the simulator on exit */
+static AxiMasterClientDeviceState *stats_dev;
+
 static uint64_t
 axi_master_client_device_read(void *opaque, hwaddr offset, unsigned size)
 {
@@ -38,16 +65,22 @@ axi_master_client_device_read(void *opaque, hwaddr offset, unsigned size)
 	msg.address = s->base_address + offset;
 	msg.data = 0;
 
+	int64_t t0 = get_clock();
 	if (send(s->sock_sync_fd, &msg, sizeof(msg), 0) == -1) {
 		perror("send");
 		exit(1);
 	}
 
+	int64_t t1 = get_clock();
 	if (recv(s->sock_sync_fd, &msg, sizeof(msg), 0) <= 0) {
 		perror("recv");
 		exit(1);
 	}
 
+	s->stats.send_ns += t1 - t0;
+	s->stats.recv_ns += get_clock() - t1;
+	s->stats.reads++;
+
 	assert(msg.code == MSG_CODE_READ_ACK);
 	return msg.data;
 }
@@ -65,16 +98,22 @@ axi_master_client_device_write(void *opaque, hwaddr offset, uint64_t value, unsi
 	msg.address = s->base_address + offset;
 	msg.data = value;
 
+	int64_t t0 = get_clock();
 	if (send(s->sock_sync_fd, &msg, sizeof(msg), 0) == -1) {
 		perror("send");
 		exit(1);
 	}
 
+	int64_t t1 = get_clock();
 	if (recv(s->sock_sync_fd, &msg, sizeof(msg), 0) <= 0) {
 		perror("recv");
 		exit(1);
 	}
 
+	s->stats.send_ns += t1 - t0;
+	s->stats.recv_ns += get_clock() - t1;
+	s->stats.writes++;
+
 	assert(msg.code == MSG_CODE_WRITE_ACK);
 }
 
@@ -90,22 +129,66 @@ async_thread(void *opaque)
 	AxiMasterClientDeviceState *s = (AxiMasterClientDeviceState *)opaque;
 
 	while (1) {
-		uint32_t irq_level;
-		if (recv(s->sock_async_fd, &irq_level, sizeof(irq_level), 0) <= 0) {
+		struct axi_master_irq_msg irq_msg;
+		if (recv(s->sock_async_fd, &irq_msg, sizeof(irq_msg), MSG_WAITALL) != sizeof(irq_msg)) {
 			perror("recv");
 			exit(1);
 		}
 
-		D(printf("Got IRQ level : %d\n", irq_level));
+		D(printf("Got IRQ level : %d seq : %u sim time : %llu\n", irq_msg.level, irq_msg.seq,
+		         (unsigned long long)irq_msg.sim_time));
 		/* Need to acquire the 'Big QEMU Lock' before reporting IRQ to main thread */
+		int64_t t0 = get_clock();
 		qemu_mutex_lock_iothread();
-		qemu_set_irq(s->irq, irq_level);
+		s->stats.irq_lock_ns += get_clock() - t0;
+		s->stats.irq_msgs++;
+		s->stats.irq_raised += irq_msg.level ? 1 : 0;
+		qemu_set_irq(s->irq, irq_msg.level);
 		qemu_mutex_unlock_iothread();
 	}
 
 	return NULL;
 }
 
+/*
+ * Counters are QOM properties, e.g. in the monitor
+ *   (qemu) qom-get /machine/unattached/device[N] stats
+ * The simulator gets them on exit and reports them next to its own.
+ */
+static char *
+axi_master_client_device_get_stats(Object *obj, Error **errp)
+{
+	AxiMasterClientDeviceState *s = AXI_MASTER_CLIENT_DEVICE(obj);
+	uint64_t accesses = s->stats.reads + s->stats.writes;
+
+	return g_strdup_printf("%" PRIu64 " reads, %" PRIu64 " writes, send %.1f us/access, "
+	                       "wait for reply %.1f us/access, %" PRIu64 " IRQ messages, "
+	                       "%" PRIu64 " raised, BQL wait %.1f us/IRQ",
+	                       s->stats.reads, s->stats.writes,
+	                       accesses ? s->stats.send_ns / 1e3 / accesses : 0.0,
+	                       accesses ? s->stats.recv_ns / 1e3 / accesses : 0.0,
+	                       s->stats.irq_msgs, s->stats.irq_raised,
+	                       s->stats.irq_msgs ? s->stats.irq_lock_ns / 1e3 / s->stats.irq_msgs : 0.0);
+}
+
+static void
+axi_master_client_device_send_stats(void)
+{
+	AxiMasterClientDeviceState *s = stats_dev;
+	struct axi_master_msg msg;
+
+	msg.code = MSG_CODE_STATS;
+	msg.address = 0;
+	msg.data = sizeof(s->stats);
+
+	s->stats.wall_ns = get_clock() - s->connect_ns;
+
+	/* Not acknowledged, nothing to do about failures this late */
+	if (send(s->sock_sync_fd, &msg, sizeof(msg), 0) == sizeof(msg)) {
+		(void)send(s->sock_sync_fd, &s->stats, sizeof(s->stats), 0);
+	}
+}
+
 static void
 axi_master_client_device_init(Object *obj)
 {
@@ -117,6 +200,11 @@ axi_master_client_device_init(Object *obj)
 	sysbus_init_irq(sbd, &s->irq);
 
 	struct sockaddr_un remote;
+	const char *sock_path = getenv(SOCK_PATH_ENV);
+
+	if (!sock_path || !*sock_path) {
+		sock_path = SOCK_PATH;
+	}
 
 	if ((s->sock_sync_fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
 		perror("socket");
@@ -130,18 +218,33 @@ axi_master_client_device_init(Object *obj)
 	printf(TYPE_AXI_MASTER_CLIENT_DEVICE ": Trying to connect...\n");
 
 	remote.sun_family = AF_UNIX;
-	snprintf(remote.sun_path, 104, "%s.%s", SOCK_PATH, "sync");
+	snprintf(remote.sun_path, 104, "%s.%s", sock_path, "sync");
 	if (connect(s->sock_sync_fd, (struct sockaddr *)&remote, sizeof(remote)) == -1) {
 		perror("connect sync");
 		exit(1);
 	}
-	snprintf(remote.sun_path, 104, "%s.%s", SOCK_PATH, "async");
+	snprintf(remote.sun_path, 104, "%s.%s", sock_path, "async");
 	if (connect(s->sock_async_fd, (struct sockaddr *)&remote, sizeof(remote)) == -1) {
 		perror("connect async");
 		exit(1);
 	}
 
 	printf(TYPE_AXI_MASTER_CLIENT_DEVICE ": Connected.\n");
+	s->connect_ns = get_clock();
+
+	object_property_add_uint64_ptr(obj, "mmio-reads", &s->stats.reads, OBJ_PROP_FLAG_READ);
+	object_property_add_uint64_ptr(obj, "mmio-writes", &s->stats.writes, OBJ_PROP_FLAG_READ);
+	object_property_add_uint64_ptr(obj, "send-ns", &s->stats.send_ns, OBJ_PROP_FLAG_READ);
+	object_property_add_uint64_ptr(obj, "recv-ns", &s->stats.recv_ns, OBJ_PROP_FLAG_READ);
+	object_property_add_uint64_ptr(obj, "irq-msgs", &s->stats.irq_msgs, OBJ_PROP_FLAG_READ);
+	object_property_add_uint64_ptr(obj, "irq-raised", &s->stats.irq_raised, OBJ_PROP_FLAG_READ);
+	object_property_add_uint64_ptr(obj, "irq-lock-ns", &s->stats.irq_lock_ns, OBJ_PROP_FLAG_READ);
+	object_property_add_str(obj, "stats", axi_master_client_device_get_stats, NULL);
+
+	if (!stats_dev) {
+		stats_dev = s;
+		atexit(axi_master_client_device_send_stats);
+	}
 
     QemuThread thread;
 	qemu_thread_create(&thread, "async_thread", async_thread, s, QEMU_THREAD_DETACHED);
@@ -2,9 +2,19 @@
 
 set -x
 
-vvp -M. -mvpi_axi_master i2c.vvp &
+SOCK=${AXI_MASTER_SOCKET:-/tmp/axi_master_socket}
+rm -f $SOCK.ready
 
-sleep 1
+# Waveforms are dumped on request of the client (-d, -t), WAVE=fst selects
+# FST (dump.fst) over VCD (dump.vcd). I2C_LOG=<file> logs the decoded bus
+# traffic, bus utilization is reported when the simulation ends.
+vvp -M. -mvpi_axi_master i2c.vvp +axi_master_socket=$SOCK ${WAVE:+-$WAVE} ${I2C_LOG:++i2c_log=$I2C_LOG} &
+SIM=$!
 
-./axi_master_client
+# The simulator creates the ready file once it is listening
+while [ ! -e $SOCK.ready ]; do
+	kill -0 $SIM || exit 1
+	sleep 0.01
+done
 
+./axi_master_client -s $SOCK "$@"
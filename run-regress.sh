@@ -0,0 +1,74 @@
+#!/bin/bash
+#
+# Run several simulations with their clients in parallel, each with its own
+# socket, working directory (waveforms) and test data seed, and summarise.
+#
+# usage: ./run-regress.sh [-j jobs] [-n runs] [client args...]
+
+TOP=$(cd $(dirname $0) && pwd)
+
+JOBS=$(nproc)
+RUNS=
+while getopts "j:n:" opt; do
+	case $opt in
+		j) JOBS=$OPTARG ;;
+		n) RUNS=$OPTARG ;;
+		*) echo "usage: $0 [-j jobs] [-n runs] [client args...]"; exit 2 ;;
+	esac
+done
+shift $((OPTIND - 1))
+RUNS=${RUNS:-$JOBS}
+
+DIR=$(mktemp -d /tmp/axi_regress.XXXXXX)
+echo "$RUNS runs, $JOBS in parallel, results in $DIR"
+
+run_one() {
+	local i=$1
+	local run=$DIR/$i
+	local sock=$run/sock
+	local start=$(date +%s.%N)
+	local rc
+
+	mkdir -p $run
+
+	(cd $run && exec vvp -M$TOP -mvpi_axi_master $TOP/i2c.vvp +axi_master_socket=$sock ${WAVE:+-$WAVE}) > $run/sim.log 2>&1 &
+	local sim=$!
+
+	while [ ! -e $sock.ready ]; do
+		if ! kill -0 $sim 2>/dev/null; then
+			echo "$i 1 0 simulator did not start" > $run/result
+			return
+		fi
+		sleep 0.01
+	done
+
+	$TOP/axi_master_client -s $sock -r $i "$@" > $run/client.log 2>&1
+	rc=$?
+	wait $sim || [ $rc != 0 ] || rc=1
+
+	echo "$i $rc $(awk "BEGIN { print $(date +%s.%N) - $start }")" > $run/result
+}
+
+for i in $(seq 1 $RUNS); do
+	while [ $(jobs -rp | wc -l) -ge $JOBS ]; do
+		wait -n
+	done
+	run_one $i "$@" &
+done
+wait
+
+PASS=0
+FAIL=0
+for i in $(seq 1 $RUNS); do
+	read n rc secs rest < $DIR/$i/result
+	if [ "$rc" = 0 ]; then
+		PASS=$((PASS + 1))
+	else
+		FAIL=$((FAIL + 1))
+		echo "FAIL run $n (exit $rc${rest:+, $rest}), logs in $DIR/$n"
+	fi
+done
+cat $DIR/*/result | awk '{ t += $3; if ($3 > max) max = $3 } END { printf("run time avg %.2fs max %.2fs\n", t / NR, max) }'
+echo "$PASS passed, $FAIL failed"
+
+[ $FAIL = 0 ]
@@ -2,6 +2,7 @@
 #include <errno.h>
 #include <fenv.h>
 #include <math.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,18 @@
 #include <unistd.h>
 #include <vpi_user.h>
 #include "axi_master.h"
+#include "vpi_i2c_monitor.h"
+#include "vpi_util.h"
+
+/*
+ * One instance drives one AXI port, with the signals of signals.def found
+ * below a hierarchical prefix, and serves one client on its own sockets.
+ * Instances are given as +axi_master=<prefix>[:<socket path>] on the vvp
+ * command line, as many times as needed. Without any, there is a single
+ * instance with prefix tb on the default socket path. Instances without a
+ * socket path after the first get <default socket path>.<n>.
+ */
+#define MAX_INSTANCES 8
 
 struct axi_values {
 #define DEF_SIGNAL(x,y)	vpiHandle x##_h;
@@ -21,224 +34,695 @@ struct axi_values {
 #define DEF_SIGNAL(x,y)	s_vpi_value x;
 #include "signals.def"
 #undef DEF_SIGNAL
-} axi_signals;
+};
+
+struct axi_inst {
+	char prefix[64];
+	char sock_path[96];
+	struct axi_values sig;
+
+	int sync_socket;
+	int async_socket;
+	int closed;
+
+	enum {s_idle, s_w_0, s_w_1, s_w_2, s_r_0, s_r_1, s_r_2} state;
+	struct axi_master_msg msg;
+
+	uint32_t irq_level_prev;
+
+	/* IRQ notifications and their turnaround, rising edge to first ack write */
+	struct {
+		uint32_t seq;
+		uint64_t cycles;        /* Clocks since reset */
+		int pending;            /* Raised and not acknowledged yet */
+		uint64_t raise_cycle;
+		struct timespec raise_wall;
+		struct lat_hist lat_cycles;
+		struct lat_hist lat_ns;
+	} irq;
+
+	/* Where the wall time goes, reported together with the client's view at exit */
+	struct {
+		uint64_t reads;
+		uint64_t writes;
+		uint64_t access_cycles;     /* Request received to reply sent */
+		uint64_t access_ns;
+		uint64_t wait_ns;           /* Blocked waiting for a request */
+		uint64_t irq_msgs;
+		uint64_t req_cycle;
+		uint64_t req_ns;
+		uint64_t connect_ns;
+		uint64_t close_ns;
+		int have_client;
+		struct axi_master_client_stats client;
+	} stats;
+
+	/* Waveform dumping, see DUMP_CMD_* */
+	struct {
+		int start_pending;      /* Scope written, turn on at the next clock */
+		uint32_t window;
+		uint32_t remaining;     /* Clocks left of a triggered dump */
+		int trig_addr;
+		uint32_t trig_addr_value;
+		int trig_nack;
+		int nack_prev;
+	} dump;
+};
 
-void signals_init()
+static struct axi_inst insts[MAX_INSTANCES];
+static int num_insts;
+
+/* Signals missing in the design (e.g. the dump control of a bare DUT port) are left alone */
+void signals_init(struct axi_inst *p)
 {
+	char name[128];
+
 #define DEF_SIGNAL(x,y) \
 do { \
-	axi_signals.x##_h = vpi_handle_by_name("tb." #x, NULL); \
+	snprintf(name, sizeof(name), "%s.%s", p->prefix, #x); \
+	p->sig.x##_h = vpi_handle_by_name(name, NULL); \
+	if (!p->sig.x##_h) { \
+		vpi_printf("%s not found\n", name); \
+	} \
 } while (0);
 #include "signals.def"
 #undef DEF_SIGNAL
 }
 
-void signals_read()
+void signals_read(struct axi_inst *p)
 {
 #define DEF_SIGNAL(x,y) \
 do { \
-	axi_signals.x.format = vpiIntVal; \
-	vpi_get_value(axi_signals.x##_h, &axi_signals.x); \
+	p->sig.x.format = vpiIntVal; \
+	if (p->sig.x##_h) { \
+		vpi_get_value(p->sig.x##_h, &p->sig.x); \
+	} \
 } while (0);
 #include "signals.def"
 #undef DEF_SIGNAL
 }
 
-void signals_write()
+void signals_write(struct axi_inst *p)
 {
 #define DEF_SIGNAL(x,y) \
 do { \
-	if (y) { \
+	if (y && p->sig.x##_h) { \
 		/* vpiInertialDelay - All scheduled events on the object shall be removed before this event is scheduled. */ \
 		s_vpi_time when; \
 		when.type = vpiSimTime; \
 		when.high = 0; \
 		when.low = 0; \
 		when.real = 0; \
-		vpi_put_value(axi_signals.x##_h, &axi_signals.x, &when, vpiInertialDelay); \
+		vpi_put_value(p->sig.x##_h, &p->sig.x, &when, vpiInertialDelay); \
 	} \
 } while (0);
 #include "signals.def"
 #undef DEF_SIGNAL
 }
 
-int clock_request()
+int clock_request(struct axi_inst *p)
+{
+	return p->sig.busy_bit.value.integer;
+}
+
+/*
+ * An idle instance may only block waiting for its client when no other
+ * instance needs the simulation to run, and then it waits for any client.
+ */
+static int all_idle(void)
+{
+	for (int i = 0; i < num_insts; i++) {
+		if (!insts[i].closed && (insts[i].state != s_idle || clock_request(&insts[i]))) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void wait_any_client(void)
+{
+	struct pollfd pfd[MAX_INSTANCES];
+	int n = 0;
+
+	for (int i = 0; i < num_insts; i++) {
+		if (!insts[i].closed) {
+			pfd[n].fd = insts[i].sync_socket;
+			pfd[n].events = POLLIN;
+			n++;
+		}
+	}
+
+	while (poll(pfd, n, -1) == -1) {
+		if (errno != EINTR) {
+			perror("poll");
+			exit(1);
+		}
+	}
+}
+
+/* IRQ acknowledge writes, per channel bank and the global cause register */
+static const uint32_t irq_ack_offset = 0x20;
+static const uint32_t irq_cause_addr = 0x1f00;
+
+static void dump_set_scope(struct axi_inst *p, uint32_t arg)
+{
+	p->sig.dump_scope.value.integer = arg & 0xff;
+	p->sig.dump_depth.value.integer = (arg >> 8) & 0xff;
+}
+
+static void dump_trigger(struct axi_inst *p, const char *why)
+{
+	vpi_printf("%s: dump triggered by %s\n", p->prefix, why);
+	p->dump.trig_addr = 0;
+	p->dump.trig_nack = 0;
+	p->dump.start_pending = 1;
+	p->dump.remaining = p->dump.window;
+}
+
+static void dump_cmd(struct axi_inst *p, uint32_t cmd, uint32_t arg)
+{
+	switch (cmd) {
+		case DUMP_CMD_START:
+			dump_set_scope(p, arg);
+			p->dump.start_pending = 1;
+			p->dump.remaining = 0;
+			break;
+		case DUMP_CMD_STOP:
+			p->dump.start_pending = 0;
+			p->dump.remaining = 0;
+			p->sig.dump_on.value.integer = 0;
+			break;
+		case DUMP_CMD_SCOPE:
+			dump_set_scope(p, arg);
+			break;
+		case DUMP_CMD_WINDOW:
+			p->dump.window = arg;
+			break;
+		case DUMP_CMD_TRIG_ADDR:
+			p->dump.trig_addr = 1;
+			p->dump.trig_addr_value = arg;
+			break;
+		case DUMP_CMD_TRIG_NACK:
+			p->dump.trig_nack = 1;
+			break;
+		case DUMP_CMD_TRIG_OFF:
+			p->dump.trig_addr = 0;
+			p->dump.trig_nack = 0;
+			break;
+		default:
+			vpi_printf("unknown dump command %u\n", cmd);
+			break;
+	}
+}
+
+/* Once per clock, before a new message is looked at */
+static void dump_clk(struct axi_inst *p)
+{
+	int nack = p->sig.i2c_nack.value.integer;
+
+	/* Scope and depth were written on the previous clock */
+	if (p->dump.start_pending) {
+		p->sig.dump_on.value.integer = 1;
+		p->dump.start_pending = 0;
+	}
+	else if (p->dump.remaining && --p->dump.remaining == 0) {
+		p->sig.dump_on.value.integer = 0;
+	}
+
+	if (p->dump.trig_nack && nack && !p->dump.nack_prev) {
+		dump_trigger(p, "NACK");
+	}
+	p->dump.nack_prev = nack;
+}
+
+static uint64_t wall_ns(void)
 {
-	return axi_signals.busy_bit.value.integer;
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+
+	return t.tv_sec * 1000000000ULL + t.tv_nsec;
 }
 
-static int axi_master_sync_socket;
-static int axi_master_async_socket;
+static void irq_report(void)
+{
+	for (int i = 0; i < num_insts; i++) {
+		struct axi_inst *p = &insts[i];
 
-static enum {s_idle, s_w_0, s_w_1, s_w_2, s_r_0, s_r_1, s_r_2} state = s_idle;
-static struct axi_master_msg msg;
+		printf("%s: IRQ to ack latency, %u IRQs%s:\n", p->prefix, p->irq.seq,
+		       p->irq.pending ? " (last one not acked)" : "");
+		lat_hist_report(&p->irq.lat_cycles, "clock cycles");
+		lat_hist_report(&p->irq.lat_ns, "wall time ns");
+	}
+}
 
-static uint32_t irq_level, irq_level_prev = 0;
+static double per(uint64_t v, uint64_t n)
+{
+	return n ? (double)v / n : 0.0;
+}
+
+/*
+ * Round trips as seen by the client minus the time the simulator spent on
+ * the access is what the sockets and scheduling cost, the time the
+ * simulator waited for requests is spent in the client (e.g. the guest).
+ */
+static void cosim_report(void)
+{
+	for (int i = 0; i < num_insts; i++) {
+		const struct axi_inst *p = &insts[i];
+		const struct axi_master_client_stats *c = &p->stats.client;
+		uint64_t accesses = p->stats.reads + p->stats.writes;
+		uint64_t end_ns = p->stats.close_ns ? p->stats.close_ns : wall_ns();
+		uint64_t wall = end_ns - p->stats.connect_ns;
+		uint64_t spent = p->stats.wait_ns + p->stats.access_ns;
+		uint64_t busy = wall > spent ? wall - spent : 0;
+
+		printf("%s: cosimulation report, %.3f s connected:\n", p->prefix, wall / 1e9);
+		printf("  simulator: %llu reads, %llu writes, %llu IRQ messages\n",
+		       (unsigned long long)p->stats.reads, (unsigned long long)p->stats.writes,
+		       (unsigned long long)p->stats.irq_msgs);
+		printf("    serving accesses   %6.1f%%  %10.1f us/access  %6.1f clock cycles/access\n",
+		       100.0 * per(p->stats.access_ns, wall), per(p->stats.access_ns, accesses) / 1e3,
+		       per(p->stats.access_cycles, accesses));
+		printf("    waiting for client %6.1f%%  %10.1f us/access\n",
+		       100.0 * per(p->stats.wait_ns, wall), per(p->stats.wait_ns, accesses) / 1e3);
+		printf("    simulating between %6.1f%%  %10.1f us/access\n",
+		       100.0 * per(busy, wall), per(busy, accesses) / 1e3);
+
+		if (!p->stats.have_client) {
+			printf("  client: no statistics received\n");
+			continue;
+		}
+
+		printf("  client: %llu reads, %llu writes, %llu IRQ messages, %llu raised\n",
+		       (unsigned long long)c->reads, (unsigned long long)c->writes,
+		       (unsigned long long)c->irq_msgs, (unsigned long long)c->irq_raised);
+		printf("    send               %6.1f%%  %10.1f us/access\n",
+		       100.0 * per(c->send_ns, c->wall_ns), per(c->send_ns, c->reads + c->writes) / 1e3);
+		printf("    waiting for reply  %6.1f%%  %10.1f us/access\n",
+		       100.0 * per(c->recv_ns, c->wall_ns), per(c->recv_ns, c->reads + c->writes) / 1e3);
+		printf("    IRQ lock wait                %10.1f us/IRQ message\n", per(c->irq_lock_ns, c->irq_msgs) / 1e3);
+		printf("  round trip %.1f us/access = simulation %.1f + sockets and scheduling %.1f\n",
+		       per(c->send_ns + c->recv_ns, c->reads + c->writes) / 1e3,
+		       per(p->stats.access_ns, accesses) / 1e3,
+		       (per(c->send_ns + c->recv_ns, c->reads + c->writes) - per(p->stats.access_ns, accesses)) / 1e3);
+	}
+}
+
+/* The client's figures, just before it disconnects */
+static void client_stats_recv(struct axi_inst *p, uint32_t len)
+{
+	uint8_t buf[256];
+
+	if (len > sizeof(buf) || recv(p->sync_socket, buf, len, MSG_WAITALL) != (ssize_t)len) {
+		vpi_printf("%s: bad client statistics\n", p->prefix);
+		return;
+	}
+
+	/* Older or newer clients send less or more, the rest stays 0 */
+	memcpy(&p->stats.client, buf, len < sizeof(p->stats.client) ? len : sizeof(p->stats.client));
+	p->stats.have_client = 1;
+}
+
+static void access_done(struct axi_inst *p)
+{
+	p->stats.access_cycles += p->irq.cycles - p->stats.req_cycle;
+	p->stats.access_ns += wall_ns() - p->stats.req_ns;
+}
+
+static int is_irq_ack(uint32_t address)
+{
+	return address == irq_cause_addr ||
+	       (address >= 0x1000 && address < irq_cause_addr && (address & 0xff) == irq_ack_offset);
+}
+
+static void irq_ack_seen(struct axi_inst *p)
+{
+	struct timespec now;
+
+	if (!p->irq.pending) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	lat_hist_add(&p->irq.lat_cycles, p->irq.cycles - p->irq.raise_cycle);
+	lat_hist_add(&p->irq.lat_ns, (now.tv_sec - p->irq.raise_wall.tv_sec) * 1000000000ULL +
+	                             now.tv_nsec - p->irq.raise_wall.tv_nsec);
+	p->irq.pending = 0;
+}
+
+static void inst_closed(struct axi_inst *p)
+{
+	vpi_printf("%s: socket closed.\n", p->prefix);
+	p->closed = 1;
+	p->stats.close_ns = wall_ns();
+
+	for (int i = 0; i < num_insts; i++) {
+		if (!insts[i].closed) {
+			return;
+		}
+	}
+	exit(0);
+}
 
 int clk_cb(p_cb_data cb)
 {
-	signals_read();
+	struct axi_inst *p = (struct axi_inst *)cb->user_data;
+
+	if (p->closed) {
+		return 0;
+	}
+
+	signals_read(p);
 
 	/* @posedge(axi_aclk) and inactive axi_aresetn */
-	if (axi_signals.axi_aresetn.value.integer && axi_signals.axi_aclk.value.integer) {
+	if (p->sig.axi_aresetn.value.integer && p->sig.axi_aclk.value.integer) {
 
 		int res;
 
 		int recv_flags = 0;
-		if (clock_request()) {
+		if (p->state == s_idle && !clock_request(p)) {
+			if (num_insts > 1) {
+				if (!all_idle()) {
+					recv_flags = MSG_DONTWAIT;
+				}
+				else {
+					/* Wakes up for any client, which need not be ours */
+					uint64_t t = wall_ns();
+					wait_any_client();
+					p->stats.wait_ns += wall_ns() - t;
+					recv_flags = MSG_DONTWAIT;
+				}
+			}
+		}
+		else {
 			recv_flags = MSG_DONTWAIT;
 		}
 
-		irq_level = axi_signals.i2c_irq.value.integer ? 1 : 0;
-		if (irq_level != irq_level_prev) {
+		p->irq.cycles++;
+
+		uint32_t irq_level = p->sig.i2c_irq.value.integer ? 1 : 0;
+		if (irq_level != p->irq_level_prev) {
+			struct axi_master_irq_msg irq_msg;
+
+			if (irq_level) {
+				p->irq.seq++;
+				p->irq.pending = 1;
+				p->irq.raise_cycle = p->irq.cycles;
+				clock_gettime(CLOCK_MONOTONIC, &p->irq.raise_wall);
+			}
+
+			irq_msg.level = irq_level;
+			irq_msg.seq = p->irq.seq;
+			irq_msg.sim_time = sim_time();
+
 			/* Dont block and dont care if it fails (e.g. nobody is recving) */
-			(void)send(axi_master_async_socket, &irq_level, sizeof(irq_level), MSG_DONTWAIT);
-			irq_level_prev = irq_level;
+			if (send(p->async_socket, &irq_msg, sizeof(irq_msg), MSG_DONTWAIT) == sizeof(irq_msg)) {
+				p->stats.irq_msgs++;
+			}
+			p->irq_level_prev = irq_level;
 		}
 
-		switch (state) {
-			case s_idle:
-				printf("about to recv() with recv_flags: %x\n", recv_flags);
-				if ((res = recv(axi_master_sync_socket, &msg, sizeof(msg), recv_flags)) != sizeof(msg)) {
+		dump_clk(p);
+
+		switch (p->state) {
+			case s_idle: {
+				uint64_t t = recv_flags ? 0 : wall_ns();
+
+				res = recv(p->sync_socket, &p->msg, sizeof(p->msg), recv_flags);
+				if (t) {
+					p->stats.wait_ns += wall_ns() - t;
+				}
+				if (res != sizeof(p->msg)) {
 					if (res == -1 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
 						return 0;
 					}
 					else if (0 == res) {
-						vpi_printf("socket closed.\n");
-						exit(0);
+						inst_closed(p);
+						return 0;
 					}
 					else {
 						perror("recv");
 						exit(1);
 					}
 				}
-				if (msg.code == MSG_CODE_WRITE_CMD) {
-					state = s_w_0;
+				if (p->msg.code == MSG_CODE_DUMP_CMD) {
+					dump_cmd(p, p->msg.address, p->msg.data);
+					p->msg.code = MSG_CODE_DUMP_ACK;
+					if (send(p->sync_socket, &p->msg, sizeof(p->msg), 0) != sizeof(p->msg)) {
+						perror("send");
+						exit(1);
+					}
+					break;
+				}
+				if (p->msg.code == MSG_CODE_STATS) {
+					client_stats_recv(p, p->msg.data);
+					break;
+				}
+				p->stats.req_cycle = p->irq.cycles;
+				p->stats.req_ns = wall_ns();
+				if (p->dump.trig_addr && p->msg.address == p->dump.trig_addr_value) {
+					dump_trigger(p, "address match");
+				}
+				if (p->msg.code == MSG_CODE_WRITE_CMD) {
+					if (is_irq_ack(p->msg.address)) {
+						irq_ack_seen(p);
+					}
+					p->state = s_w_0;
 				}
 				else {
-					assert(msg.code == MSG_CODE_READ_CMD);
-					state = s_r_0;
+					assert(p->msg.code == MSG_CODE_READ_CMD);
+					p->state = s_r_0;
 				}
 				break;
+			}
 
 			case s_w_0:
-				axi_signals.axi_awvalid.value.integer = 1;
-				axi_signals.axi_awaddr.value.integer = msg.address;
+				p->sig.axi_awvalid.value.integer = 1;
+				p->sig.axi_awaddr.value.integer = p->msg.address;
 
-				axi_signals.axi_wvalid.value.integer = 1;
-				axi_signals.axi_wstrb.value.integer = 0xf;
-				axi_signals.axi_wdata.value.integer = msg.data;
+				p->sig.axi_wvalid.value.integer = 1;
+				p->sig.axi_wstrb.value.integer = 0xf;
+				p->sig.axi_wdata.value.integer = p->msg.data;
 
-				state = s_w_1;
+				p->state = s_w_1;
 				break;
 
 			case s_w_1:
-				if (axi_signals.axi_awready.value.integer && axi_signals.axi_wready.value.integer) {
-					axi_signals.axi_awvalid.value.integer = 0;
-					axi_signals.axi_wvalid.value.integer = 0;
-					axi_signals.axi_bready.value.integer = 1;
-					state = s_w_2;
+				if (p->sig.axi_awready.value.integer && p->sig.axi_wready.value.integer) {
+					p->sig.axi_awvalid.value.integer = 0;
+					p->sig.axi_wvalid.value.integer = 0;
+					p->sig.axi_bready.value.integer = 1;
+					p->state = s_w_2;
 				}
 				break;
 
 			case s_w_2:
-				if (axi_signals.axi_bvalid.value.integer) {
-					axi_signals.axi_bready.value.integer = 0;
+				if (p->sig.axi_bvalid.value.integer) {
+					p->sig.axi_bready.value.integer = 0;
 
-					msg.code = MSG_CODE_WRITE_ACK;
-					if (send(axi_master_sync_socket, &msg, sizeof(msg), 0) != sizeof(msg)) {
+					p->msg.code = MSG_CODE_WRITE_ACK;
+					if (send(p->sync_socket, &p->msg, sizeof(p->msg), 0) != sizeof(p->msg)) {
 						perror("send");
 						exit(1);
 					}
-					state = s_idle;
+					p->stats.writes++;
+					access_done(p);
+					p->state = s_idle;
 				}
 				break;
 
 			case s_r_0:
-				axi_signals.axi_arvalid.value.integer = 1;
-				axi_signals.axi_araddr.value.integer = msg.address;
+				p->sig.axi_arvalid.value.integer = 1;
+				p->sig.axi_araddr.value.integer = p->msg.address;
 
-				state = s_r_1;
+				p->state = s_r_1;
 				break;
 
 			case s_r_1:
-				if (axi_signals.axi_arready.value.integer) {
-					axi_signals.axi_arvalid.value.integer = 0;
-					axi_signals.axi_rready.value.integer = 1;
+				if (p->sig.axi_arready.value.integer) {
+					p->sig.axi_arvalid.value.integer = 0;
+					p->sig.axi_rready.value.integer = 1;
 
-					state = s_r_2;
+					p->state = s_r_2;
 				}
 				break;
 
 			case s_r_2:
-				if (axi_signals.axi_rvalid.value.integer) {
-					axi_signals.axi_rready.value.integer = 0;
+				if (p->sig.axi_rvalid.value.integer) {
+					p->sig.axi_rready.value.integer = 0;
 
-					msg.data = axi_signals.axi_rdata.value.integer;
-					msg.code = MSG_CODE_READ_ACK;
-					if (send(axi_master_sync_socket, &msg, sizeof(msg), 0) != sizeof(msg)) {
+					p->msg.data = p->sig.axi_rdata.value.integer;
+					p->msg.code = MSG_CODE_READ_ACK;
+					if (send(p->sync_socket, &p->msg, sizeof(p->msg), 0) != sizeof(p->msg)) {
 						perror("send");
 						exit(1);
 					}
-					state = s_idle;
+					p->stats.reads++;
+					access_done(p);
+					p->state = s_idle;
 				}
 				break;
 		}
 	}
 
-	signals_write();
+	signals_write(p);
 
 	return 0;
 }
 
-void wait_for_axi_master_client(void)
+/* Value of +<name>=<value> (or "" for plain +<name>) on the vvp command line, NULL when absent */
+static const char *get_plusarg(const char *name)
 {
-	int sync_listen_socket;
-	int async_listen_socket;
-	unsigned t;
-	struct sockaddr_un local, remote;
+	s_vpi_vlog_info info;
+	size_t len = strlen(name);
+
+	if (vpi_get_vlog_info(&info)) {
+		for (int i = 0; i < info.argc; i++) {
+			const char *arg = info.argv[i];
+			if (arg[0] == '+' && !strncmp(arg + 1, name, len)) {
+				if (arg[len + 1] == '=') {
+					return arg + len + 2;
+				}
+				if (arg[len + 1] == 0) {
+					return "";
+				}
+			}
+		}
+	}
 
-	if ((sync_listen_socket = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		perror("socket sync");
-		exit(1);
+	return NULL;
+}
+
+static const char *get_sock_path(void)
+{
+	const char *path = get_plusarg("axi_master_socket");
+
+	return path && *path ? path : axi_master_sock_path();
+}
+
+/* <prefix>[:<socket path>] */
+static void inst_add(const char *spec)
+{
+	struct axi_inst *p;
+	const char *colon = strchr(spec, ':');
+	int len = colon ? colon - spec : (int)strlen(spec);
+
+	if (num_insts == MAX_INSTANCES) {
+		vpi_printf("too many AXI master instances, %s ignored\n", spec);
+		return;
+	}
+
+	p = &insts[num_insts];
+	snprintf(p->prefix, sizeof(p->prefix), "%.*s", len, spec);
+	if (colon && colon[1]) {
+		snprintf(p->sock_path, sizeof(p->sock_path), "%s", colon + 1);
+	}
+	else if (num_insts == 0) {
+		snprintf(p->sock_path, sizeof(p->sock_path), "%s", get_sock_path());
 	}
-	if ((async_listen_socket = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
-		perror("socket async");
+	else {
+		snprintf(p->sock_path, sizeof(p->sock_path), "%s.%d", get_sock_path(), num_insts);
+	}
+	p->state = s_idle;
+	num_insts++;
+}
+
+static void insts_init(void)
+{
+	s_vpi_vlog_info info;
+	static const char opt[] = "+axi_master=";
+
+	if (vpi_get_vlog_info(&info)) {
+		for (int i = 0; i < info.argc; i++) {
+			if (!strncmp(info.argv[i], opt, strlen(opt))) {
+				inst_add(info.argv[i] + strlen(opt));
+			}
+		}
+	}
+
+	if (num_insts == 0) {
+		inst_add("tb");
+	}
+}
+
+/* Tell whoever launched us that the client may connect now */
+static void signal_ready(struct axi_inst *p)
+{
+	char path[108];
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s.%s", p->sock_path, SOCK_READY_SUFFIX);
+	if ((f = fopen(path, "w")) == NULL) {
+		perror("fopen ready");
 		exit(1);
 	}
+	fprintf(f, "%d\n", (int)getpid());
+	fclose(f);
+}
 
-	local.sun_family = AF_UNIX;
-	snprintf(local.sun_path, 104, "%s.%s", SOCK_PATH, "sync");
-	unlink(local.sun_path);
-	if (bind(sync_listen_socket, (struct sockaddr *)&local, sizeof(local)) == -1) {
-		perror("bind");
+static int listen_on(struct axi_inst *p, const char *suffix)
+{
+	struct sockaddr_un local;
+	int s;
+
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		perror("socket");
 		exit(1);
 	}
-	snprintf(local.sun_path, 104, "%s.%s", SOCK_PATH, "async");
+
+	local.sun_family = AF_UNIX;
+	snprintf(local.sun_path, 104, "%s.%s", p->sock_path, suffix);
 	unlink(local.sun_path);
-	if (bind(async_listen_socket, (struct sockaddr *)&local, sizeof(local)) == -1) {
+	if (bind(s, (struct sockaddr *)&local, sizeof(local)) == -1) {
 		perror("bind");
 		exit(1);
 	}
 
-	if (listen(sync_listen_socket, 5) == -1) {
-		perror("listen");
-		exit(1);
-	}
-	if (listen(async_listen_socket, 5) == -1) {
+	if (listen(s, 5) == -1) {
 		perror("listen");
 		exit(1);
 	}
 
-	printf("Waiting for a connection...\n");
-	t = sizeof(remote);
-	if ((axi_master_sync_socket = accept(sync_listen_socket, (struct sockaddr *)&remote, &t)) == -1) {
+	return s;
+}
+
+static int accept_on(int listen_socket)
+{
+	struct sockaddr_un remote;
+	unsigned t = sizeof(remote);
+	int s;
+
+	if ((s = accept(listen_socket, (struct sockaddr *)&remote, &t)) == -1) {
 		perror("accept");
 		exit(1);
 	}
-	if ((axi_master_async_socket = accept(async_listen_socket, (struct sockaddr *)&remote, &t)) == -1) {
-		perror("accept");
-		exit(1);
+
+	return s;
+}
+
+/* All instances listen before any waits, so their clients may connect in any order */
+void wait_for_axi_master_clients(void)
+{
+	int sync_listen_socket[MAX_INSTANCES];
+	int async_listen_socket[MAX_INSTANCES];
+
+	for (int i = 0; i < num_insts; i++) {
+		sync_listen_socket[i] = listen_on(&insts[i], "sync");
+		async_listen_socket[i] = listen_on(&insts[i], "async");
+		signal_ready(&insts[i]);
+	}
+
+	for (int i = 0; i < num_insts; i++) {
+		struct axi_inst *p = &insts[i];
+
+		printf("Waiting for a connection on %s...\n", p->sock_path);
+		p->sync_socket = accept_on(sync_listen_socket[i]);
+		p->async_socket = accept_on(async_listen_socket[i]);
+		close(sync_listen_socket[i]);
+		close(async_listen_socket[i]);
+		p->stats.connect_ns = wall_ns();
 	}
 
 	printf("Connected.\n");
@@ -246,25 +730,39 @@ void wait_for_axi_master_client(void)
 
 int start_of_sim_cb(p_cb_data unused)
 {
-	vpiHandle clk;
-	p_cb_data cb = malloc(sizeof(s_cb_data));
+	insts_init();
 
-	clk = vpi_handle_by_name("tb.axi_aclk", NULL);
+	for (int i = 0; i < num_insts; i++) {
+		struct axi_inst *p = &insts[i];
+		p_cb_data cb = malloc(sizeof(s_cb_data));
 
-	cb->reason = cbValueChange;
-	cb->cb_rtn = clk_cb;
-	cb->obj = clk;
-	cb->time = (p_vpi_time)malloc(sizeof(s_vpi_time));
-	cb->time->type = vpiSuppressTime;
-	cb->value = (p_vpi_value)malloc(sizeof(s_vpi_value));
-	cb->value->format = vpiScalarVal;
-	cb->user_data = NULL;
+		signals_init(p);
 
-	vpi_register_cb(cb);
+		cb->reason = cbValueChange;
+		cb->cb_rtn = clk_cb;
+		cb->obj = p->sig.axi_aclk_h;
+		cb->time = (p_vpi_time)malloc(sizeof(s_vpi_time));
+		cb->time->type = vpiSuppressTime;
+		cb->value = (p_vpi_value)malloc(sizeof(s_vpi_value));
+		cb->value->format = vpiScalarVal;
+		cb->user_data = (PLI_BYTE8 *)p;
+
+		vpi_register_cb(cb);
+
+		/* +dump dumps everything from the start, like it always used to */
+		if (get_plusarg("dump")) {
+			dump_cmd(p, DUMP_CMD_START, 0);
+		}
+
+		/* +i2c_log=<file> also writes the decoded bus traffic */
+		i2c_monitor_init(p->prefix, get_plusarg("i2c_log"));
+	}
 
-	signals_init();
+	/* The simulation ends with exit() once the clients disconnect */
+	atexit(cosim_report);
+	atexit(irq_report);
 
-	wait_for_axi_master_client();
+	wait_for_axi_master_clients();
 
 	return 0;
 }
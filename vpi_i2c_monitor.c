@@ -0,0 +1,321 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vpi_user.h>
+#include "vpi_i2c_monitor.h"
+#include "vpi_util.h"
+
+#define MAX_CHANNELS 15
+#define MAX_MONITORS 8
+
+/*
+ * Gaps are measured from the SCL rising edge of the acknowledge bit of one
+ * byte to that of the first bit of the next one, less one bit period. That is
+ * zero for bytes sent back to back, anything above is time the controller sat
+ * waiting for software (or a start/stop condition in between).
+ */
+enum gap_phase {
+	GAP_ADDR_DATA,  /* Address byte to first data byte */
+	GAP_DATA_DATA,  /* Between data bytes */
+	GAP_RESTART,    /* Byte to address byte after a repeated start */
+	GAP_IDLE,       /* Last byte of a transaction to first of the next */
+	NUM_GAP_PHASES
+};
+
+static const char *gap_names[NUM_GAP_PHASES] = {
+	"address -> data", "data -> data", "repeated start", "stop -> start",
+};
+
+struct i2c_mon_chan {
+	int scl, sda;
+
+	int in_xfer;
+	int bit_cnt;
+	uint32_t shift;
+	int addr_byte;          /* Current byte is an address byte */
+	int restart;            /* It follows a repeated start */
+	int rd;                 /* Read transfer, data bytes are acknowledged by the master */
+	int prev_addr_byte;     /* Previous byte was an address byte */
+
+	uint64_t t_prev_rise;
+	uint64_t t_last_ack;    /* SCL rising edge of the last acknowledge bit, 0 if none yet */
+	uint64_t t_xfer_start;
+
+	uint64_t bit_period;    /* Shortest SCL period seen within a byte */
+	uint64_t bytes;
+	uint64_t nacks;
+	uint64_t xfers;
+	uint64_t held;          /* Time from start to stop conditions */
+	uint64_t t_first;
+	uint64_t t_last;
+	struct lat_hist gaps[NUM_GAP_PHASES];
+
+	char line[4096];        /* Transaction being logged */
+};
+
+/* One per testbench instance, all sharing the log */
+struct i2c_mon {
+	char prefix[64];
+	vpiHandle scl_h;
+	vpiHandle sda_h;
+	int num_chan;
+	struct i2c_mon_chan chan[MAX_CHANNELS];
+};
+
+static struct i2c_mon mons[MAX_MONITORS];
+static int num_mons;
+static FILE *mon_log;
+
+/* Bit n of a vector, x and z (released bus) read as 1 */
+static int vec_bit(const s_vpi_value *v, int n)
+{
+	const s_vpi_vecval *w = &v->value.vector[n / 32];
+
+	return ((uint32_t)(w->aval | w->bval) >> (n % 32)) & 1;
+}
+
+static void log_append(struct i2c_mon_chan *c, const char *fmt, unsigned arg)
+{
+	size_t len = strlen(c->line);
+
+	if (len < sizeof(c->line) - 16) {
+		snprintf(c->line + len, sizeof(c->line) - len, fmt, arg);
+	}
+}
+
+static void on_start(struct i2c_mon_chan *c, uint64_t t)
+{
+	if (c->in_xfer) {
+		c->restart = 1;
+		log_append(c, " Sr", 0);
+	}
+	else {
+		c->in_xfer = 1;
+		c->restart = 0;
+		c->t_xfer_start = t;
+		if (!c->t_first) {
+			c->t_first = t;
+		}
+		snprintf(c->line, sizeof(c->line), "%llu: S", (unsigned long long)t);
+	}
+	c->addr_byte = 1;
+	c->bit_cnt = 0;
+}
+
+static void on_stop(struct i2c_mon *mon, struct i2c_mon_chan *c, int n, uint64_t t)
+{
+	if (!c->in_xfer) {
+		return;
+	}
+
+	c->in_xfer = 0;
+	c->xfers++;
+	c->held += t - c->t_xfer_start;
+	c->t_last = t;
+
+	if (mon_log) {
+		fprintf(mon_log, "%s ch%d %s P\n", mon->prefix, n, c->line);
+	}
+}
+
+static void on_scl_rise(struct i2c_mon_chan *c, uint64_t t)
+{
+	if (!c->in_xfer) {
+		return;
+	}
+
+	if (c->bit_cnt == 0) {
+		/* First bit of a byte */
+		if (c->t_last_ack) {
+			enum gap_phase phase;
+			if (c->addr_byte) {
+				phase = c->restart ? GAP_RESTART : GAP_IDLE;
+			}
+			else {
+				phase = c->prev_addr_byte ? GAP_ADDR_DATA : GAP_DATA_DATA;
+			}
+			lat_hist_add(&c->gaps[phase], t - c->t_last_ack);
+		}
+		c->shift = 0;
+	}
+	else if (!c->bit_period || t - c->t_prev_rise < c->bit_period) {
+		c->bit_period = t - c->t_prev_rise;
+	}
+	c->t_prev_rise = t;
+
+	if (c->bit_cnt < 8) {
+		c->shift = c->shift << 1 | c->sda;
+		c->bit_cnt++;
+		return;
+	}
+
+	/* Acknowledge bit */
+	c->bytes++;
+	if (c->sda) {
+		c->nacks++;
+	}
+	if (c->addr_byte) {
+		c->rd = c->shift & 1;
+		log_append(c, " %02x", c->shift >> 1);
+		log_append(c, c->rd ? "R" : "W", 0);
+	}
+	else {
+		log_append(c, " %02x", c->shift);
+	}
+	log_append(c, c->sda ? " N" : " A", 0);
+
+	c->prev_addr_byte = c->addr_byte;
+	c->addr_byte = 0;
+	c->restart = 0;
+	c->bit_cnt = 0;
+	c->t_last_ack = t;
+}
+
+static int bus_cb(p_cb_data cb)
+{
+	struct i2c_mon *mon = (struct i2c_mon *)cb->user_data;
+	s_vpi_value scl, sda;
+	uint64_t t = sim_time();
+
+	scl.format = vpiVectorVal;
+	vpi_get_value(mon->scl_h, &scl);
+	sda.format = vpiVectorVal;
+	vpi_get_value(mon->sda_h, &sda);
+
+	for (int n = 0; n < mon->num_chan; n++) {
+		struct i2c_mon_chan *c = &mon->chan[n];
+		int new_scl = vec_bit(&scl, n);
+		int new_sda = vec_bit(&sda, n);
+
+		if (new_sda != c->sda && c->scl && new_scl) {
+			/* SDA changing while SCL is high, start or stop condition */
+			if (new_sda) {
+				on_stop(mon, c, n, t);
+			}
+			else {
+				on_start(c, t);
+			}
+		}
+		c->sda = new_sda;
+
+		if (new_scl && !c->scl) {
+			on_scl_rise(c, t);
+		}
+		c->scl = new_scl;
+	}
+
+	return 0;
+}
+
+static void gap_report(const struct lat_hist *g, const char *name, uint64_t bit_period)
+{
+	/* Excess over a back to back byte */
+	uint64_t min = g->min > bit_period ? g->min - bit_period : 0;
+	uint64_t max = g->max > bit_period ? g->max - bit_period : 0;
+	double avg = (double)g->sum / g->count - bit_period;
+
+	printf("    %-16s %8llu  min %10llu  avg %12.1f  max %10llu  (%.1f bits avg)\n",
+	       name, (unsigned long long)g->count, (unsigned long long)min, avg < 0 ? 0 : avg,
+	       (unsigned long long)max, bit_period ? avg / bit_period : 0.0);
+}
+
+static void i2c_monitor_report_one(const struct i2c_mon *mon)
+{
+	printf("%s: I2C bus monitor (times in simulation time units):\n", mon->prefix);
+
+	for (int n = 0; n < mon->num_chan; n++) {
+		const struct i2c_mon_chan *c = &mon->chan[n];
+		uint64_t window = c->t_last - c->t_first;
+		uint64_t wire = c->bytes * 9 * c->bit_period;
+
+		if (!c->xfers) {
+			printf("  channel %d: idle\n", n);
+			continue;
+		}
+
+		printf("  channel %d: %llu transactions, %llu bytes, %llu NACKs, bit period %llu\n",
+		       n, (unsigned long long)c->xfers, (unsigned long long)c->bytes,
+		       (unsigned long long)c->nacks, (unsigned long long)c->bit_period);
+		printf("    first start to last stop %llu, bus held %.1f%%, shifting bits %.1f%%\n",
+		       (unsigned long long)window, window ? 100.0 * c->held / window : 0.0,
+		       window ? 100.0 * wire / window : 0.0);
+		printf("    gaps before byte   count  (time beyond back to back transfer)\n");
+		for (int p = 0; p < NUM_GAP_PHASES; p++) {
+			if (c->gaps[p].count) {
+				gap_report(&c->gaps[p], gap_names[p], c->bit_period);
+			}
+		}
+	}
+}
+
+static void i2c_monitor_report(void)
+{
+	for (int i = 0; i < num_mons; i++) {
+		i2c_monitor_report_one(&mons[i]);
+	}
+
+	if (mon_log) {
+		fclose(mon_log);
+	}
+}
+
+static void register_bus_cb(struct i2c_mon *mon, vpiHandle h)
+{
+	p_cb_data cb = malloc(sizeof(s_cb_data));
+
+	cb->reason = cbValueChange;
+	cb->cb_rtn = bus_cb;
+	cb->obj = h;
+	cb->time = (p_vpi_time)malloc(sizeof(s_vpi_time));
+	cb->time->type = vpiSuppressTime;
+	cb->value = (p_vpi_value)malloc(sizeof(s_vpi_value));
+	cb->value->format = vpiSuppressVal;
+	cb->user_data = (PLI_BYTE8 *)mon;
+
+	vpi_register_cb(cb);
+}
+
+void i2c_monitor_init(const char *prefix, const char *log_path)
+{
+	struct i2c_mon *mon;
+	char name[128];
+
+	if (num_mons == MAX_MONITORS) {
+		return;
+	}
+	mon = &mons[num_mons];
+
+	snprintf(mon->prefix, sizeof(mon->prefix), "%s", prefix);
+	snprintf(name, sizeof(name), "%s.i2c_scl", prefix);
+	mon->scl_h = vpi_handle_by_name(name, NULL);
+	snprintf(name, sizeof(name), "%s.i2c_sda_io", prefix);
+	mon->sda_h = vpi_handle_by_name(name, NULL);
+	if (!mon->scl_h || !mon->sda_h) {
+		vpi_printf("%s: i2c monitor: bus signals not found, disabled\n", prefix);
+		return;
+	}
+
+	mon->num_chan = vpi_get(vpiSize, mon->scl_h);
+	if (mon->num_chan > MAX_CHANNELS) {
+		mon->num_chan = MAX_CHANNELS;
+	}
+	for (int n = 0; n < mon->num_chan; n++) {
+		mon->chan[n].scl = 1;
+		mon->chan[n].sda = 1;
+	}
+
+	register_bus_cb(mon, mon->scl_h);
+	register_bus_cb(mon, mon->sda_h);
+
+	if (num_mons++ > 0) {
+		return;
+	}
+
+	if (log_path && *log_path && (mon_log = fopen(log_path, "w")) == NULL) {
+		perror(log_path);
+	}
+
+	/* The simulation ends with exit() once the clients disconnect */
+	atexit(i2c_monitor_report);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+/*
+ * Passive monitor of the I2C buses below prefix (<prefix>.i2c_scl and
+ * <prefix>.i2c_sda_io, one bit per channel). Decodes the traffic into a
+ * transaction log, written to log_path unless NULL, and reports bus
+ * utilization and inter-byte gap statistics when the simulation exits.
+ * Called once per instance, the log of the first call is used for all.
+ */
+void i2c_monitor_init(const char *prefix, const char *log_path);
@@ -0,0 +1,44 @@
+#include <stdio.h>
+#include <vpi_user.h>
+#include "vpi_util.h"
+
+uint64_t sim_time(void)
+{
+	s_vpi_time t;
+
+	t.type = vpiSimTime;
+	vpi_get_time(NULL, &t);
+
+	return (uint64_t)t.high << 32 | t.low;
+}
+
+void lat_hist_add(struct lat_hist *h, uint64_t v)
+{
+	int n = v ? 64 - __builtin_clzll(v) : 0;
+
+	h->bucket[n < LAT_BUCKETS ? n : LAT_BUCKETS - 1]++;
+	if (h->count == 0 || v < h->min) {
+		h->min = v;
+	}
+	if (v > h->max) {
+		h->max = v;
+	}
+	h->sum += v;
+	h->count++;
+}
+
+void lat_hist_report(const struct lat_hist *h, const char *unit)
+{
+	if (!h->count) {
+		return;
+	}
+
+	printf("  %s: count %llu  min %llu  avg %.1f  max %llu\n", unit,
+	       (unsigned long long)h->count, (unsigned long long)h->min,
+	       (double)h->sum / h->count, (unsigned long long)h->max);
+	for (int n = 0; n < LAT_BUCKETS; n++) {
+		if (h->bucket[n]) {
+			printf("    < %-12llu %8llu\n", 1ULL << n, (unsigned long long)h->bucket[n]);
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+/*
+ * Helpers shared by the VPI modules.
+ */
+
+/* Current simulation time in simulation time units */
+uint64_t sim_time(void);
+
+#define LAT_BUCKETS 32
+
+/* Bucket n counts values in [2^(n-1), 2^n), bucket 0 counts zero */
+struct lat_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t bucket[LAT_BUCKETS];
+};
+
+void lat_hist_add(struct lat_hist *h, uint64_t v);
+/* Print count, min/avg/max and the non-empty buckets, nothing if empty */
+void lat_hist_report(const struct lat_hist *h, const char *unit);